@@ -0,0 +1,99 @@
+#include "src/WaveEdit.hpp"
+#include <chrono>
+
+
+/** Runs `f` repeatedly for about `seconds` and returns the average time per call in nanoseconds */
+static double measure(const std::function<void()> &f, double seconds = 0.2) {
+	typedef std::chrono::steady_clock Clock;
+	// Warm up caches and lazily built tables
+	f();
+	int64_t calls = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed;
+	do {
+		for (int i = 0; i < 100; i++) {
+			f();
+		}
+		calls += 100;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < seconds);
+	return elapsed / calls * 1e9;
+}
+
+
+static void benchFFT() {
+	for (int len : {WAVE_LEN, WAVE_LEN * 4}) {
+		ALIGNED static float in[WAVE_LEN * 4];
+		ALIGNED static float out[WAVE_LEN * 4];
+		for (int i = 0; i < len; i++) {
+			in[i] = randf() * 2.0 - 1.0;
+		}
+		printf("RFFT %d: %.0f ns\n", len, measure([&]{ RFFT(in, out, len); }));
+		printf("IRFFT %d: %.0f ns\n", len, measure([&]{ IRFFT(out, in, len); }));
+	}
+
+	static float in[BANK_LEN][WAVE_LEN];
+	static float out[BANK_LEN][WAVE_LEN];
+	const float *ins[BANK_LEN];
+	float *outs[BANK_LEN];
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < WAVE_LEN; i++) {
+			in[j][i] = randf() * 2.0 - 1.0;
+		}
+		ins[j] = in[j];
+		outs[j] = out[j];
+	}
+	printf("RFFTBatch %d x %d: %.0f ns\n", BANK_LEN, WAVE_LEN, measure([&]{ RFFTBatch(ins, outs, WAVE_LEN, BANK_LEN); }));
+}
+
+
+/** Prints the cost of the preview voice pool per voice and sample, and how many voices one core could play in real time */
+static void benchVoices() {
+	static WaveTable tables[BANK_LEN];
+	for (int w = 0; w < BANK_LEN; w++) {
+		float samples[WAVE_LEN];
+		for (int i = 0; i < WAVE_LEN; i++) {
+			samples[i] = randf() * 2.0 - 1.0;
+		}
+		tables[w].build(samples);
+	}
+
+	const int len = 256;
+	float frequency[len];
+	float morphX[len];
+	float morphY[len];
+	float morphZ[len];
+	float out[len];
+	for (int i = 0; i < len; i++) {
+		frequency[i] = 220.0;
+		// Sweep across wave boundaries, which splits the block into segments
+		morphX[i] = 2.0 + 2.0 * i / len;
+		morphY[i] = 3.5;
+		morphZ[i] = 10.0 + 2.0 * i / len;
+	}
+
+	static VoicePool pool;
+	for (float sampleRate : {44100.0, 96000.0}) {
+		for (int xy = 0; xy < 2; xy++) {
+			for (int count : {1, 8, 64}) {
+				pool.count = count;
+				for (int v = 0; v < count; v++) {
+					pool.ratio[v] = powf(2.0, v / 24.0);
+					pool.morphOffset[v] = v * 0.3;
+				}
+				double ns = measure([&]{
+					pool.process(tables, frequency, xy ? morphX : NULL, xy ? morphY : NULL, morphZ, sampleRate, out, len);
+				}) / (len * count);
+				printf("VoicePool %s %d voices at %.0f Hz: %.2f ns per voice-sample, %.0f voices per core\n", xy ? "XY" : "Z", count, sampleRate, ns, 1e9 / ns / sampleRate);
+			}
+		}
+	}
+}
+
+
+int main(int argc, char **argv) {
+	parallelInit();
+	benchFFT();
+	benchVoices();
+	parallelDestroy();
+}
@@ -11,8 +11,29 @@
 #include <thread>
 #include <vector>
 #include <complex>
+#include <functional>
+#include <memory>
+#include <atomic>
 
 
+/** Alignment in bytes of sample buffers, enough for aligned SSE loads. The AVX2 kernels only use unaligned loads */
+#define SIMD_ALIGN 16
+#define ALIGNED alignas(SIMD_ALIGN)
+
+/** Allocates memory aligned to SIMD_ALIGN. Throws std::bad_alloc on failure, like new */
+void *alignedMalloc(size_t size);
+void alignedFree(void *ptr);
+
+/** Declares operator new and delete for a struct with ALIGNED members.
+Before C++17, new ignores alignas, and malloc on 32-bit Windows only aligns to 8 bytes.
+Containers such as std::vector still use the global operator new.
+*/
+#define ALIGNED_NEW \
+	static void *operator new(size_t size) {return alignedMalloc(size);} \
+	static void *operator new[](size_t size) {return alignedMalloc(size);} \
+	static void operator delete(void *ptr) {alignedFree(ptr);} \
+	static void operator delete[](void *ptr) {alignedFree(ptr);}
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 
@@ -91,9 +112,38 @@ inline void cmultf(float *cr, float *ci, float ar, float ai, float br, float bi)
 	*ci = ar * bi + ai * br;
 }
 
+/** Real FFT, normalized by 1/len, in pffft's ordered format.
+WAVE_LEN and WAVE_LEN * 4 use a specialized transform, and other lengths are much slower.
+*/
 void RFFT(const float *in, float *out, int len);
 void IRFFT(const float *in, float *out, int len);
 
+/** Computes RFFT() of `count` signals.
+`in` and `out` are arrays of `count` pointers to signals.
+*/
+void RFFTBatch(const float *const *in, float *const *out, int len, int count);
+/** Computes IRFFT() of `count` signals */
+void IRFFTBatch(const float *const *in, float *const *out, int len, int count);
+
+/** Whether the CPU supports the AVX2 kernels, which are then used in place of the SSE2 code */
+bool useAVX2();
+
+// Vectorized math over arrays, using AVX2 when the CPU supports it
+// `out` may alias the input
+
+/** out = sin(x), with error below 2e-7 for |x| < 1000 */
+void sinv(const float *x, float *out, int len);
+/** out = sin(2 pi x), with error below 2e-7 */
+void sin2piv(const float *x, float *out, int len);
+/** outSin = sin(2 pi x) and outCos = cos(2 pi x), with error below 2e-7 */
+void sincos2piv(const float *x, float *outSin, float *outCos, int len);
+/** out = asin(x) for |x| <= 1, with error below 3e-7 */
+void asinv(const float *x, float *out, int len);
+/** out = round(x), rounding half away from zero like roundf() */
+void roundv(const float *x, float *out, int len);
+/** Magnitudes of `len` interleaved complex numbers `z`, like hypotf() but without its overflow protection */
+void cabsv(const float *z, float *out, int len);
+
 int resample(const float *in, int inLen, float *out, int outLen, double ratio);
 void cyclicOversample(const float *in, float *out, int len, int oversample);
 void i16_to_f32(const int16_t *in, float *out, int length);
@@ -106,6 +156,8 @@ void f32_to_i16(const float *in, int16_t *out, int length);
 
 /** Opens a URL, also happens to work with PDFs */
 void openBrowser(const char *url);
+/** Renames a file, atomically replacing `to` if it exists. Returns false on failure */
+bool renameReplace(const char *from, const char *to);
 /** Caller must free(). Returns NULL if unsuccessful */
 float *loadAudio(const char *filename, int *length);
 /** Converts a printf format to a std::string */
@@ -115,6 +167,63 @@ void ellipsize(char *str, int maxLen);
 unsigned char *base64_encode(const unsigned char *src, size_t len, size_t *out_len);
 unsigned char *base64_decode(const unsigned char *src, size_t len, size_t *out_len);
 
+/** Number of timings kept by a TimingRing */
+#define TIMING_RING_LEN 1024
+
+/** Processing times of a periodic real-time task.
+One thread pushes and any other thread may read, without locks.
+*/
+struct TimingRing {
+	struct Entry {
+		/** Seconds spent processing */
+		float duration;
+		/** Seconds of audio processed, which is the deadline */
+		float period;
+	};
+	Entry entries[TIMING_RING_LEN];
+	/** Total number of entries ever pushed */
+	std::atomic<uint32_t> head;
+	/** Number of entries whose duration exceeded their period */
+	std::atomic<uint32_t> overruns;
+
+	TimingRing();
+	void clear();
+	/** Only call from the producer thread */
+	void push(float duration, float period);
+	/** Copies up to `len` of the most recent entries to `out`, oldest first, and returns how many were copied */
+	int read(Entry *out, int len) const;
+};
+
+struct TimingSummary {
+	int count;
+	float durationMin;
+	float durationAvg;
+	float durationMax;
+	/** Fraction of the period used */
+	float loadAvg;
+	float loadMax;
+	uint32_t overruns;
+};
+
+/** Summarizes the `window` most recent entries */
+void timingSummarize(const TimingRing *ring, int window, TimingSummary *summary);
+/** Writes the summary and the most recent entries as JSON. `label` names what was timed. Returns false on failure */
+bool timingSaveJSON(const TimingRing *ring, const char *label, int sampleRate, int bufferSize, const char *filename);
+
+
+////////////////////
+// parallel.cpp
+////////////////////
+
+/** Starts a persistent pool of worker threads, one per core besides the calling thread */
+void parallelInit();
+void parallelDestroy();
+/** Calls `f(i)` for each i in [0, len) across the worker threads and the calling thread, returning when all calls have finished.
+`f` must be safe to call concurrently for different indices.
+Runs serially if the pool is not running.
+*/
+void parallelFor(int len, const std::function<void(int)> &f);
+
 
 ////////////////////
 // wave.cpp
@@ -140,7 +249,8 @@ enum EffectID {
 
 extern const char *effectNames[EFFECTS_LEN];
 
-struct Wave {
+/** Every sample array is a multiple of SIMD_ALIGN bytes, so aligning the struct aligns each of them */
+struct ALIGNED Wave {
 	float samples[WAVE_LEN];
 	/** FFT of wave, interleaved complex numbers */
 	float spectrum[WAVE_LEN];
@@ -155,9 +265,16 @@ struct Wave {
 	bool cycle;
 	bool normalize;
 
+	ALIGNED_NEW
 	void clear();
 	/** Generates post arrays from the sample array, by applying effects */
 	void updatePost();
+	/** Like updatePost() but only generates postSamples, leaving postSpectrum and postHarmonics stale */
+	void updatePostSamples();
+	/** Generates harmonics from spectrum */
+	void updateHarmonics();
+	/** Generates postHarmonics from postSpectrum */
+	void updatePostHarmonics();
 	void commitSamples();
 	void commitHarmonics();
 	void clearEffects();
@@ -185,19 +302,32 @@ extern bool clipboardActive;
 struct Bank {
 	Wave waves[BANK_LEN];
 
+	ALIGNED_NEW
+
 	void clear();
+	/** Equivalent to calling Wave::commitSamples() on every wave, but batches the FFTs across the bank */
+	void commitSamples();
+	/** Like commitSamples() for the `len` waves with indices `ids` */
+	void commitSamples(const int *ids, int len);
 	void swap(int i, int j);
 	void shuffle();
 	/** `in` must be length BANK_LEN * WAVE_LEN */
 	void setSamples(const float *in);
+	/** Calls Wave::updatePost() on every wave in parallel */
+	void updateAllPost();
+	void clearEffects();
+	void bakeEffects();
+	void randomizeEffects();
 	void getPostSamples(float *out);
 	void duplicateToAll(int waveId);
-	/** Binary dump of the bank struct */
-	void save(const char *filename);
-	void load(const char *filename);
+	/** Binary dump of the bank struct. Returns false on failure */
+	bool save(const char *filename);
+	/** Returns false if the file could not be opened or is too short. The bank is cleared in either case */
+	bool load(const char *filename);
 	/** WAV file with BANK_LEN * WAVE_LEN samples */
 	void saveWAV(const char *filename);
-	void loadWAV(const char *filename);
+	/** Returns false if the file could not be opened, leaving the bank cleared */
+	bool loadWAV(const char *filename);
 	/** Saves each wave to its own file in a directory */
 	void saveWaves(const char *dirname);
 };
@@ -211,11 +341,36 @@ struct Bank {
 void historyPush();
 void historyUndo();
 void historyRedo();
+/** Deletes all history, including the journal on disk */
 void historyClear();
 
+/** Bytes of undo states to keep in memory. Older states are moved to a journal file next to autosave.dat. Applies at the next push */
+extern int historyBudget;
+
+struct HistoryStats {
+	size_t memoryBytes;
+	int memoryStates;
+	size_t diskBytes;
+	int diskStates;
+};
+
+void historyGetStats(HistoryStats *stats);
+
 extern Bank currentBank;
 
 
+////////////////////
+// autosave.cpp
+////////////////////
+
+/** Loads currentBank from autosave.dat and the journal of changes since, and starts the thread which writes the journal */
+void autosaveInit();
+/** Hands the waves changed since the last call to the autosave thread. Call from the UI thread once per frame */
+void autosaveUpdate();
+/** Writes the remaining changes and folds the journal into autosave.dat */
+void autosaveDestroy();
+
+
 ////////////////////
 // catalog.cpp
 ////////////////////
@@ -223,26 +378,151 @@ extern Bank currentBank;
 struct CatalogFile {
 	float samples[WAVE_LEN];
 	std::string name;
+	/** Name in its directory, e.g. "00Sine.wav" */
+	std::string filename;
 };
 
 struct CatalogCategory {
 	std::vector<CatalogFile> files;
+	/** Nested directories, in alphabetical order, including empty ones */
+	std::vector<CatalogCategory> subcategories;
 	std::string name;
+	/** Name in its directory, e.g. "00Digital" */
+	std::string dirName;
+
+	/** Whether there are no files in the category or any of its subcategories */
+	bool empty() const;
 };
 
-extern std::vector<CatalogCategory> catalogCategories;
+/** Categories in alphabetical order */
+typedef std::vector<std::shared_ptr<const CatalogCategory>> Catalog;
 
+/** Returns the categories scanned so far. Safe to call from any thread, and the returned catalog is never modified */
+std::shared_ptr<const Catalog> catalogGet();
+/** Starts scanning the catalog directory in the background. On Linux, later changes to the directory are applied to the catalog as they happen */
 void catalogInit();
+void catalogDestroy();
+
+
+////////////////////
+// similar.cpp
+////////////////////
+
+/** Dimensions of the principal component space waves are compared in */
+#define SIMILAR_DIMS 16
+#define SIMILAR_MATCHES_MAX 64
+
+struct SimilarMatch {
+	CatalogFile file;
+	/** e.g. "Digital/Bells" */
+	std::string categoryName;
+	float distance;
+};
+
+/** Rebuilds the similarity index over every wave in `catalog`. Searches use the previous index until it is done */
+void similarBuild(const std::shared_ptr<const Catalog> &catalog);
+/** Finds up to `k` catalog waves with harmonic spectra closest in shape to `samples`, nearest first.
+Returns the number found, or 0 if the index isn't built yet.
+*/
+int similarFind(const float *samples, SimilarMatch *matches, int k);
+
+
+////////////////////
+// oscillator.cpp
+////////////////////
+
+/** Number of octave-spaced band-limited copies of each wave */
+#define MIP_LEVELS 8
+
+/** Band-limited copies of a wave for alias-free playback at any frequency */
+struct ALIGNED WaveTable {
+	/** Level `l` contains the harmonics below (WAVE_LEN / 2) >> l.
+	The first sample is repeated at the end, so interpolation never wraps.
+	*/
+	float levels[MIP_LEVELS][WAVE_LEN + 1];
+
+	ALIGNED_NEW
+
+	/** Rebuilds every level from a wave of length WAVE_LEN */
+	void build(const float *samples);
+};
+
+/** Chooses the mip levels for playback at `frequency` Hz, such that no harmonic reaches the Nyquist frequency.
+Sets `level` and a fraction for crossfading into the next level, which also keeps under the Nyquist frequency, so the timbre changes smoothly between octaves.
+*/
+void mipSelect(float frequency, float sampleRate, int *level, float *levelFrac);
+
+#define VOICES_MAX 64
+/** Voices are processed in groups of this many, one per SIMD lane */
+#define VOICE_GROUP 8
+
+/** A pool of oscillator voices playing from the same bank.
+State is stored as structure of arrays, so the lookups and crossfades of a group of voices vectorize.
+On CPUs with AVX2, a group's table lookups are single gather instructions.
+*/
+struct ALIGNED VoicePool {
+	int count = 1;
+	/** Position in the wave cycle, in [0, 1) */
+	float phase[VOICES_MAX];
+	/** Frequency of each voice relative to the played frequency */
+	float ratio[VOICES_MAX];
+	/** Offset of each voice from the played Z morph position */
+	float morphOffset[VOICES_MAX];
+
+	ALIGNED_NEW
+	VoicePool();
+	/** Writes the sum of all voices to `out`, scaled by 1/sqrt(count).
+	`frequency` and the morph positions are given per sample.
+	If `morphX` and `morphY` are non-NULL, morphs bilinearly across the bank grid, otherwise along `morphZ`.
+	*/
+	void process(const WaveTable *tables, const float *frequency, const float *morphX, const float *morphY, const float *morphZ, float sampleRate, float *out, int len);
+};
+
+
+////////////////////
+// render.cpp
+////////////////////
+
+/** A piecewise linear function over the duration of a render, through evenly spaced points */
+struct RenderCurve {
+	std::vector<float> points;
+
+	/** `t` is the position in the render, from 0 to 1 */
+	float value(float t) const;
+	/** Parses comma-separated values. Returns false if `str` is malformed */
+	bool parse(const char *str);
+};
+
+struct RenderSettings {
+	float duration = 4.0;
+	int sampleRate = 44100;
+	/** In dB */
+	float volume = 0.0;
+	/** In Hz, interpolated exponentially between points */
+	RenderCurve frequency;
+	/** Morphs across the grid with morphX and morphY if either has points, otherwise along morphZ */
+	RenderCurve morphX;
+	RenderCurve morphY;
+	RenderCurve morphZ;
+	/** If set, writes the processing time of each block as JSON to this path */
+	std::string statsPath;
+};
+
+/** Plays the post-effect waves of `bank` into a 16-bit WAV file without the audio device, faster than real time.
+Returns false if the file could not be written. Not reentrant.
+*/
+bool renderBank(const Bank *bank, const RenderSettings &settings, const char *filename);
+/** Entry point for `WaveEdit --render ...`, with the arguments after --render. Returns the process exit code */
+int renderMain(int argc, char **argv);
 
 
 ////////////////////
 // audio.cpp
 ////////////////////
 
-// TODO Some of these should not be exposed in the header
+// Playback parameters, owned by the UI thread. audioUpdate() sends changes to the audio thread, which never reads these directly
 extern float playVolume;
 extern float playFrequency;
-extern float playFrequencySmooth;
 extern bool playEnabled;
 extern bool playModeXY;
 extern bool morphInterpolate;
@@ -250,14 +530,37 @@ extern float morphX;
 extern float morphY;
 extern float morphZ;
 extern float morphZSpeed;
-extern int playIndex;
+/** Number of voices in the preview, from 1 to VOICES_MAX */
+extern int playVoices;
+#define CHORDS_LEN 6
+extern const char *chordNames[CHORDS_LEN];
+/** Index into chordNames. Voices play the chord's notes in turn, an octave higher each time around */
+extern int playChord;
+/** Width of the range of Z morph positions the voices are spread across */
+extern float playMorphSpread;
 extern const char *audioDeviceName;
 extern Bank *playingBank;
 
+/** Sends changed playback parameters and publishes the waves of playingBank to the audio thread. Call from the UI thread once per frame */
+void audioUpdate();
+/** The device opened by audioOpen(), or -1 for the default device */
+extern int audioDeviceId;
+/** Requested sample rate and buffer size in frames. Call audioOpen() to apply */
+extern int audioSampleRate;
+extern int audioBufferSize;
+/** Processing time of each audio callback */
+extern TimingRing audioTiming;
+
 int audioGetDeviceCount();
 const char *audioGetDeviceName(int deviceId);
 void audioClose();
 void audioOpen(int deviceId);
+/** Returns the duration of the negotiated buffer in seconds, or 0 if no device is open */
+float audioGetLatency();
+/** Returns the average deviation in seconds of the time between audio callbacks from the buffer duration */
+float audioGetJitter();
+/** Gets the format negotiated with the device. Returns false if no device is open */
+bool audioGetSpec(int *sampleRate, int *bufferSize, int *channels, int *bits);
 void audioInit();
 void audioDestroy();
 
@@ -1,11 +1,10 @@
 #include "WaveEdit.hpp"
 #include <SDL.h>
-#include <samplerate.h>
+#include <atomic>
 
 
 float playVolume = -12.0;
 float playFrequency = 220.0;
-float playFrequencySmooth = playFrequency;
 bool playModeXY = false;
 bool playEnabled = false;
 bool morphInterpolate = true;
@@ -13,102 +12,460 @@ float morphX = 0.0;
 float morphY = 0.0;
 float morphZ = 0.0;
 float morphZSpeed = 0.0;
-int playIndex = 0;
+int playVoices = 1;
+int playChord = 0;
+float playMorphSpread = 0.0;
 Bank *playingBank;
 
-static float morphXSmooth = morphX;
-static float morphYSmooth = morphY;
-static float morphZSmooth = morphZ;
+const char *chordNames[CHORDS_LEN] = {
+	"Unison",
+	"Octaves",
+	"Fifths",
+	"Major",
+	"Minor",
+	"Dominant 7th",
+};
+
+struct Chord {
+	int len;
+	float semitones[4];
+	/** Interval added each time the voices wrap around the chord */
+	float repeat;
+};
+
+static const Chord chords[CHORDS_LEN] = {
+	{1, {0}, 0},
+	{1, {0}, 12},
+	{2, {0, 7}, 12},
+	{3, {0, 4, 7}, 12},
+	{3, {0, 3, 7}, 12},
+	{4, {0, 4, 7, 10}, 12},
+};
+
+int audioDeviceId = -1;
+int audioSampleRate = 44100;
+int audioBufferSize = 1024;
+TimingRing audioTiming;
 static SDL_AudioDeviceID audioDevice = 0;
 static SDL_AudioSpec audioSpec;
-static SRC_STATE *audioSrc = NULL;
-
-long srcCallback(void *cb_data, float **data) {
-	float gain = powf(10.0, playVolume / 20.0);
-	// Generate next samples
-	const int inLen = 64;
-	static float in[inLen];
-	for (int i = 0; i < inLen; i++) {
-		if (morphInterpolate) {
-			const float lambdaMorph = fminf(0.1 / playFrequency, 0.5);
-			morphXSmooth = crossf(morphXSmooth, clampf(morphX, 0.0, BANK_GRID_WIDTH - 1), lambdaMorph);
-			morphYSmooth = crossf(morphYSmooth, clampf(morphY, 0.0, BANK_GRID_HEIGHT - 1), lambdaMorph);
-			morphZSmooth = crossf(morphZSmooth, clampf(morphZ, 0.0, BANK_LEN - 1), lambdaMorph);
-		}
-		else {
-			// Snap X, Y, Z
-			morphXSmooth = roundf(morphX);
-			morphYSmooth = roundf(morphY);
-			morphZSmooth = roundf(morphZ);
+/** Mono samples for devices which could not be opened with mono floats */
+static std::vector<float> audioConvertBuffer;
+static Uint64 audioLastCallback = 0;
+/** Only touched by the audio thread */
+static float audioJitterSmooth = 0.0;
+/** In seconds, published by the audio thread */
+static std::atomic<float> audioJitter(0.0);
+
+/** The waves of playingBank as heard by the audio thread */
+struct ALIGNED PlaybackBuffer {
+	/** The postSamples each table was built from */
+	float samples[BANK_LEN][WAVE_LEN];
+	WaveTable tables[BANK_LEN];
+};
+
+/** Triple buffer of playback data.
+The UI thread fills its back buffer and swaps it with the middle buffer, and the audio thread swaps the middle buffer with its front buffer when a fresh one is available.
+Neither thread ever waits for the other, and the audio thread always reads a complete bank.
+*/
+static PlaybackBuffer playbackBuffers[3];
+/** Index of the middle buffer, or'd with PLAYBACK_FRESH if the audio thread has not taken it yet */
+static std::atomic<int> playbackMiddle(1);
+#define PLAYBACK_FRESH 4
+// Owned by the UI thread
+static int playbackBack = 0;
+static int playbackLast = 2;
+// Owned by the audio thread
+static int playbackFront = 2;
+
+
+/** Samples per call to VoicePool::process() */
+#define AUDIO_BLOCK 256
+
+// Parameter messaging.
+// The UI edits the play* and morph* globals. audioUpdate() sends the changes to the audio thread as timestamped commands through a lock-free queue, so the audio thread never reads UI state.
+
+enum AudioParam {
+	PLAY_ENABLED_PARAM,
+	PLAY_VOLUME_PARAM,
+	PLAY_FREQUENCY_PARAM,
+	PLAY_MODE_XY_PARAM,
+	MORPH_INTERPOLATE_PARAM,
+	MORPH_X_PARAM,
+	MORPH_Y_PARAM,
+	MORPH_Z_PARAM,
+	MORPH_Z_SPEED_PARAM,
+	PLAY_VOICES_PARAM,
+	PLAY_CHORD_PARAM,
+	PLAY_MORPH_SPREAD_PARAM,
+	AUDIO_PARAMS_LEN
+};
+
+struct AudioCommand {
+	AudioParam param;
+	float value;
+	/** Sample frame at which the change takes effect. Commands which are already late take effect at the start of the next block */
+	int64_t frame;
+};
+
+#define AUDIO_COMMANDS_LEN 256
+
+/** Single-producer single-consumer ring. The UI thread advances the head and the audio thread advances the tail */
+static AudioCommand audioCommands[AUDIO_COMMANDS_LEN];
+static std::atomic<uint32_t> audioCommandsHead(0);
+static std::atomic<uint32_t> audioCommandsTail(0);
+
+/** Called from the UI thread. Returns false if the queue is full */
+static bool audioCommandPush(const AudioCommand &command) {
+	uint32_t head = audioCommandsHead.load(std::memory_order_relaxed);
+	if (head - audioCommandsTail.load(std::memory_order_acquire) >= AUDIO_COMMANDS_LEN)
+		return false;
+	audioCommands[head % AUDIO_COMMANDS_LEN] = command;
+	audioCommandsHead.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/** Called from the audio thread. Returns NULL if the queue is empty */
+static const AudioCommand *audioCommandPeek() {
+	uint32_t tail = audioCommandsTail.load(std::memory_order_relaxed);
+	if (tail == audioCommandsHead.load(std::memory_order_acquire))
+		return NULL;
+	return &audioCommands[tail % AUDIO_COMMANDS_LEN];
+}
+
+static void audioCommandPop() {
+	audioCommandsTail.store(audioCommandsTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// State of the audio thread
+
+/** Parameter values as received by the audio thread, with bools and ints stored as floats */
+static float params[AUDIO_PARAMS_LEN];
+/** Frames rendered since the device was opened */
+static int64_t audioFrame = 0;
+static float morphXSmooth = 0.0;
+static float morphYSmooth = 0.0;
+static float morphZSmooth = 0.0;
+static float frequencySmooth = 220.0;
+static float gainSmooth = 0.0;
+static VoicePool voices;
+
+/** (1 - lambda)^(i + 1) for the morph smoothing coefficient at the sample rate morphDecayRate */
+static float morphDecay[AUDIO_BLOCK];
+static int morphDecayRate = 0;
+
+// State published by the audio thread, as a seqlock.
+// The sequence is odd while the audio thread is writing.
+static std::atomic<uint32_t> stateSequence(0);
+static std::atomic<int64_t> stateFrame(0);
+static std::atomic<Uint64> stateCounter(0);
+static std::atomic<float> stateMorphZ(0.0);
+
+static void statePublish(Uint64 counter) {
+	uint32_t sequence = stateSequence.load(std::memory_order_relaxed);
+	stateSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	stateFrame.store(audioFrame, std::memory_order_relaxed);
+	stateCounter.store(counter, std::memory_order_relaxed);
+	stateMorphZ.store(params[MORPH_Z_PARAM], std::memory_order_relaxed);
+	stateSequence.store(sequence + 2, std::memory_order_release);
+}
+
+static void stateRead(int64_t *frame, Uint64 *counter, float *morphZ) {
+	while (true) {
+		uint32_t sequence = stateSequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+			continue;
+		*frame = stateFrame.load(std::memory_order_relaxed);
+		*counter = stateCounter.load(std::memory_order_relaxed);
+		*morphZ = stateMorphZ.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (stateSequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+}
+
+// State of the UI thread
+
+/** The values last sent to the audio thread */
+static float sentParams[AUDIO_PARAMS_LEN];
+static bool sentAll = false;
+/** Frame of the last Z command, so Z isn't read back before the audio thread has applied it */
+static int64_t morphZSentFrame = 0;
+
+
+/** Tunes and spreads the voices from the chord settings */
+static void updateVoices() {
+	int count = clampi(params[PLAY_VOICES_PARAM], 1, VOICES_MAX);
+	const Chord *chord = &chords[clampi(params[PLAY_CHORD_PARAM], 0, CHORDS_LEN - 1)];
+	float spread = params[PLAY_MORPH_SPREAD_PARAM];
+	voices.count = count;
+	for (int v = 0; v < count; v++) {
+		float semitones = chord->semitones[v % chord->len] + chord->repeat * (v / chord->len);
+		// Spread unison voices across +-10 cents, so they don't beat against each other
+		if (chord->repeat == 0.f && count > 1)
+			semitones += 0.2 * ((float) v / (count - 1) - 0.5);
+		voices.ratio[v] = powf(2.0, semitones / 12.0);
+		voices.morphOffset[v] = (count > 1) ? spread * ((float) v / (count - 1) - 0.5) : 0.0;
+	}
+}
+
+/** Renders one block with constant parameters */
+static void audioRenderBlock(const WaveTable *tables, float *out, int len) {
+	if (len <= 0)
+		return;
+	bool enabled = params[PLAY_ENABLED_PARAM];
+	// Ramp the gain across the block, so volume changes and play/stop don't click
+	float gainStart = gainSmooth;
+	float gainEnd = enabled ? powf(10.0, params[PLAY_VOLUME_PARAM] / 20.0) : 0.0;
+	gainSmooth = gainEnd;
+	if (gainStart == 0.0 && gainEnd == 0.0) {
+		memset(out, 0, sizeof(float) * len);
+		return;
+	}
+	updateVoices();
+
+	// Exponential smoothing of frequency in log space, halving the distance about every 23 ms
+	float frequencyTarget = clampf(params[PLAY_FREQUENCY_PARAM], 1.0, 10000.0);
+	float frequencyStart = frequencySmooth;
+	float frequencyDecay = powf(0.5, len / (0.023 * audioSpec.freq));
+	frequencySmooth = frequencyTarget * powf(frequencyStart / frequencyTarget, frequencyDecay);
+	float frequencyEnd = frequencySmooth;
+
+	// Exponential morph smoothing with a time constant of about 40 ms, independent of frequency
+	// After n samples, the smoothed value is target + (start - target) * (1 - lambda)^n, so each block is computed in closed form
+	if (morphDecayRate != audioSpec.freq) {
+		const float lambdaMorph = fminf(0.1 * WAVE_LEN / audioSpec.freq, 0.5);
+		float decay = 1.0;
+		for (int i = 0; i < AUDIO_BLOCK; i++) {
+			decay *= 1.0 - lambdaMorph;
+			morphDecay[i] = decay;
 		}
+		morphDecayRate = audioSpec.freq;
+	}
+	float targetX = clampf(params[MORPH_X_PARAM], 0.0, BANK_GRID_WIDTH - 1);
+	float targetY = clampf(params[MORPH_Y_PARAM], 0.0, BANK_GRID_HEIGHT - 1);
+	float targetZ = clampf(params[MORPH_Z_PARAM], 0.0, BANK_LEN - 1);
+	bool interpolate = params[MORPH_INTERPOLATE_PARAM];
+	if (!interpolate) {
+		// Snap X, Y, Z
+		morphXSmooth = roundf(targetX);
+		morphYSmooth = roundf(targetY);
+		morphZSmooth = roundf(targetZ);
+	}
 
-		int index = (playIndex + i) % WAVE_LEN;
-		if (playModeXY) {
-			// Morph XY
-			int xi = morphXSmooth;
-			float xf = morphXSmooth - xi;
-			int yi = morphYSmooth;
-			float yf = morphYSmooth - yi;
-			// 2D linear interpolate
-			float v0 = crossf(
-				playingBank->waves[yi * BANK_GRID_WIDTH + xi].postSamples[index],
-				playingBank->waves[yi * BANK_GRID_WIDTH + eucmodi(xi + 1, BANK_GRID_WIDTH)].postSamples[index],
-				xf);
-			float v1 = crossf(
-				playingBank->waves[eucmodi(yi + 1, BANK_GRID_HEIGHT) * BANK_GRID_WIDTH + xi].postSamples[index],
-				playingBank->waves[eucmodi(yi + 1, BANK_GRID_HEIGHT) * BANK_GRID_WIDTH + eucmodi(xi + 1, BANK_GRID_WIDTH)].postSamples[index],
-				xf);
-			in[i] = crossf(v0, v1, yf);
+	float frequency[AUDIO_BLOCK];
+	float blockMorphX[AUDIO_BLOCK];
+	float blockMorphY[AUDIO_BLOCK];
+	float blockMorphZ[AUDIO_BLOCK];
+	if (interpolate) {
+		float dx = morphXSmooth - targetX;
+		float dy = morphYSmooth - targetY;
+		float dz = morphZSmooth - targetZ;
+		for (int i = 0; i < len; i++) {
+			blockMorphX[i] = targetX + dx * morphDecay[i];
+			blockMorphY[i] = targetY + dy * morphDecay[i];
+			blockMorphZ[i] = targetZ + dz * morphDecay[i];
 		}
-		else {
-			// Morph Z
-			int zi = morphZSmooth;
-			float zf = morphZSmooth - zi;
-			in[i] = crossf(
-				playingBank->waves[zi].postSamples[index],
-				playingBank->waves[eucmodi(zi + 1, BANK_LEN)].postSamples[index],
-				zf);
+		// Same value as the last sample of the block
+		morphXSmooth = targetX + dx * morphDecay[len - 1];
+		morphYSmooth = targetY + dy * morphDecay[len - 1];
+		morphZSmooth = targetZ + dz * morphDecay[len - 1];
+	}
+	else {
+		for (int i = 0; i < len; i++) {
+			blockMorphX[i] = morphXSmooth;
+			blockMorphY[i] = morphYSmooth;
+			blockMorphZ[i] = morphZSmooth;
 		}
-		in[i] = clampf(in[i] * gain, -1.0, 1.0);
+	}
+	for (int i = 0; i < len; i++) {
+		frequency[i] = crossf(frequencyStart, frequencyEnd, (float) (i + 1) / len);
 	}
 
-	playIndex += inLen;
-	playIndex %= WAVE_LEN;
+	if (params[PLAY_MODE_XY_PARAM])
+		voices.process(tables, frequency, blockMorphX, blockMorphY, blockMorphZ, audioSpec.freq, out, len);
+	else
+		voices.process(tables, frequency, NULL, NULL, blockMorphZ, audioSpec.freq, out, len);
+	for (int i = 0; i < len; i++) {
+		float gain = crossf(gainStart, gainEnd, (float) (i + 1) / len);
+		out[i] = clampf(out[i] * gain, -1.0, 1.0);
+	}
 
-	*data = in;
-	return inLen;
+	// Modulate Z
+	float speed = params[MORPH_Z_SPEED_PARAM];
+	if (!params[PLAY_MODE_XY_PARAM] && speed > 0.f) {
+		float deltaZ = speed * len / audioSpec.freq;
+		deltaZ = clampf(deltaZ, 0.f, 1.f);
+		float z = params[MORPH_Z_PARAM] + (BANK_LEN-1) * deltaZ;
+		if (z >= (BANK_LEN-1)) {
+			z = fmodf(z, (BANK_LEN-1));
+			morphZSmooth = z;
+		}
+		params[MORPH_Z_PARAM] = z;
+	}
 }
 
+/** Renders mono float samples, applying parameter changes at their timestamps */
+static void audioRender(float *out, int outLen) {
+	// Take the latest bank published by audioUpdate()
+	if (playbackMiddle.load(std::memory_order_relaxed) & PLAYBACK_FRESH) {
+		playbackFront = playbackMiddle.exchange(playbackFront, std::memory_order_acq_rel) & ~PLAYBACK_FRESH;
+	}
+	const WaveTable *tables = playbackBuffers[playbackFront].tables;
+
+	int j = 0;
+	while (j < outLen) {
+		int64_t frame = audioFrame + j;
+		// Apply commands which are due
+		const AudioCommand *command;
+		while ((command = audioCommandPeek()) && command->frame <= frame) {
+			params[command->param] = command->value;
+			audioCommandPop();
+		}
+		// End the block early at the next command
+		int blockLen = mini(AUDIO_BLOCK, outLen - j);
+		if (command && command->frame < frame + blockLen)
+			blockLen = command->frame - frame;
 
-void audioCallback(void *userdata, Uint8 *stream, int len) {
-	float *out = (float *) stream;
-	int outLen = len / sizeof(float);
-
-	if (playEnabled) {
-		// Apply exponential smoothing to frequency
-		const float lambdaFrequency = 0.5;
-		playFrequency = clampf(playFrequency, 1.0, 10000.0);
-		playFrequencySmooth = powf(playFrequencySmooth, 1.0 - lambdaFrequency) * powf(playFrequency, lambdaFrequency);
-		double ratio = (double)audioSpec.freq / WAVE_LEN / playFrequencySmooth;
-
-		src_callback_read(audioSrc, ratio, outLen, out);
-
-		// Modulate Z
-		if (!playModeXY && morphZSpeed > 0.f) {
-			float deltaZ = morphZSpeed * outLen / audioSpec.freq;
-			deltaZ = clampf(deltaZ, 0.f, 1.f);
-			morphZ += (BANK_LEN-1) * deltaZ;
-			if (morphZ >= (BANK_LEN-1)) {
-				morphZ = fmodf(morphZ, (BANK_LEN-1));
-				morphZSmooth = morphZ;
+		audioRenderBlock(tables, &out[j], blockLen);
+		j += blockLen;
+	}
+	audioFrame += outLen;
+}
+
+/** Converts mono float samples to the obtained format, duplicating them to each channel */
+static void audioConvert(const float *in, Uint8 *stream, int frames) {
+	int channels = audioSpec.channels;
+	for (int i = 0; i < frames; i++) {
+		float x = clampf(in[i], -1.0, 1.0);
+		for (int c = 0; c < channels; c++) {
+			int k = i * channels + c;
+			switch (audioSpec.format) {
+				case AUDIO_F32SYS: ((float*) stream)[k] = x; break;
+				case AUDIO_S32SYS: ((Sint32*) stream)[k] = x * 2147483647.0; break;
+				case AUDIO_S16SYS: ((Sint16*) stream)[k] = x * 32767.0; break;
+				case AUDIO_U16SYS: ((Uint16*) stream)[k] = x * 32767.0 + 32768.0; break;
+				case AUDIO_S8: ((Sint8*) stream)[k] = x * 127.0; break;
+				case AUDIO_U8: stream[k] = x * 127.0 + 128.0; break;
+				// Opposite endianness is never chosen by SDL for a device, but fill with silence to be safe
+				default: memset(stream, audioSpec.silence, frames * channels * SDL_AUDIO_BITSIZE(audioSpec.format) / 8); return;
 			}
 		}
 	}
+}
+
+void audioCallback(void *userdata, Uint8 *stream, int len) {
+	// Measure the deviation of the time between callbacks from the buffer period
+	Uint64 now = SDL_GetPerformanceCounter();
+	if (audioLastCallback > 0) {
+		double period = (double) audioSpec.samples / audioSpec.freq;
+		double elapsed = (double) (now - audioLastCallback) / SDL_GetPerformanceFrequency();
+		const float lambdaJitter = 0.05;
+		audioJitterSmooth = crossf(audioJitterSmooth, fabs(elapsed - period), lambdaJitter);
+		audioJitter = audioJitterSmooth;
+	}
+	audioLastCallback = now;
+
+	int frames = len / (audioSpec.channels * SDL_AUDIO_BITSIZE(audioSpec.format) / 8);
+	if (audioSpec.format == AUDIO_F32SYS && audioSpec.channels == 1) {
+		audioRender((float*) stream, frames);
+	}
 	else {
-		for (int i = 0; i < outLen; i++) {
-			out[i] = 0.0;
+		float *mono = audioConvertBuffer.data();
+		frames = mini(frames, audioConvertBuffer.size());
+		audioRender(mono, frames);
+		audioConvert(mono, stream, frames);
+	}
+
+	statePublish(now);
+
+	Uint64 end = SDL_GetPerformanceCounter();
+	audioTiming.push((double) (end - now) / SDL_GetPerformanceFrequency(), (double) frames / audioSpec.freq);
+}
+
+/** Sends parameters which the UI changed since the last call */
+static void audioSendParams() {
+	float values[AUDIO_PARAMS_LEN];
+	values[PLAY_ENABLED_PARAM] = playEnabled;
+	values[PLAY_VOLUME_PARAM] = playVolume;
+	values[PLAY_FREQUENCY_PARAM] = playFrequency;
+	values[PLAY_MODE_XY_PARAM] = playModeXY;
+	values[MORPH_INTERPOLATE_PARAM] = morphInterpolate;
+	values[MORPH_X_PARAM] = morphX;
+	values[MORPH_Y_PARAM] = morphY;
+	values[MORPH_Z_PARAM] = morphZ;
+	values[MORPH_Z_SPEED_PARAM] = morphZSpeed;
+	values[PLAY_VOICES_PARAM] = playVoices;
+	values[PLAY_CHORD_PARAM] = playChord;
+	values[PLAY_MORPH_SPREAD_PARAM] = playMorphSpread;
+
+	// Stamp the changes one buffer after the estimated current play position, so they are heard with constant latency rather than quantized to callbacks
+	int64_t frame;
+	Uint64 counter;
+	float audioMorphZ;
+	stateRead(&frame, &counter, &audioMorphZ);
+	int64_t renderedFrame = frame;
+	if (audioDevice > 0 && counter > 0) {
+		double elapsed = (double) (SDL_GetPerformanceCounter() - counter) / SDL_GetPerformanceFrequency();
+		frame += (int64_t) (fmin(elapsed, (double) audioSpec.samples / audioSpec.freq) * audioSpec.freq) + audioSpec.samples;
+	}
+
+	for (int i = 0; i < AUDIO_PARAMS_LEN; i++) {
+		if (sentAll && values[i] == sentParams[i])
+			continue;
+		AudioCommand command;
+		command.param = (AudioParam) i;
+		command.value = values[i];
+		command.frame = frame;
+		// If the queue is full, sentParams is left alone so the change is retried next frame
+		if (audioCommandPush(command)) {
+			sentParams[i] = values[i];
+			if (i == MORPH_Z_PARAM)
+				morphZSentFrame = command.frame;
 		}
 	}
+	sentAll = true;
+
+	// Follow Z as the audio thread modulates it, unless the user moved it and the audio thread hasn't caught up yet
+	if (morphZSpeed > 0.f && !playModeXY && renderedFrame > morphZSentFrame) {
+		morphZ = audioMorphZ;
+		sentParams[MORPH_Z_PARAM] = audioMorphZ;
+	}
+}
+
+void audioUpdate() {
+	audioSendParams();
+	if (!playingBank)
+		return;
+	PlaybackBuffer *back = &playbackBuffers[playbackBack];
+	const PlaybackBuffer *last = &playbackBuffers[playbackLast];
+
+	// Bring the back buffer up to date, only rebuilding the tables of waves which changed since the last publish
+	// Only the UI thread writes to the buffers, so the last published one can still be read here
+	bool changed[BANK_LEN];
+	bool anyChanged = false;
+	for (int i = 0; i < BANK_LEN; i++) {
+		changed[i] = memcmp(last->samples[i], playingBank->waves[i].postSamples, sizeof(float) * WAVE_LEN) != 0;
+		anyChanged = anyChanged || changed[i];
+	}
+	if (!anyChanged)
+		return;
+
+	parallelFor(BANK_LEN, [&](int i) {
+		const float *postSamples = playingBank->waves[i].postSamples;
+		if (memcmp(back->samples[i], postSamples, sizeof(float) * WAVE_LEN) == 0)
+			return;
+		if (!changed[i]) {
+			back->tables[i] = last->tables[i];
+		}
+		else {
+			back->tables[i].build(postSamples);
+		}
+		memcpy(back->samples[i], postSamples, sizeof(float) * WAVE_LEN);
+	});
+
+	playbackLast = playbackBack;
+	playbackBack = playbackMiddle.exchange(playbackBack | PLAYBACK_FRESH, std::memory_order_acq_rel) & ~PLAYBACK_FRESH;
 }
 
 int audioGetDeviceCount() {
@@ -122,38 +479,71 @@ const char *audioGetDeviceName(int deviceId) {
 void audioClose() {
 	if (audioDevice > 0) {
 		SDL_CloseAudioDevice(audioDevice);
+		audioDevice = 0;
 	}
 }
 
 /** if deviceName is -1, the default audio device is chosen */
 void audioOpen(int deviceId) {
 	audioClose();
+	audioDeviceId = deviceId;
 
 	SDL_AudioSpec spec;
 	memset(&spec, 0, sizeof(spec));
-	spec.freq = 44100;
-	spec.format = AUDIO_F32;
+	spec.freq = audioSampleRate;
+	spec.format = AUDIO_F32SYS;
 	spec.channels = 1;
-	spec.samples = 1024;
+	spec.samples = clampi(audioBufferSize, 64, 4096);
 	spec.callback = audioCallback;
 
 	const char *deviceName = deviceId >= 0 ? SDL_GetAudioDeviceName(deviceId, 0) : NULL;
-	// TODO Be more tolerant of devices which can't use floats or 1 channel
 	audioDevice = SDL_OpenAudioDevice(deviceName, 0, &spec, &audioSpec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
-	if (audioDevice <= 0)
+	if (audioDevice <= 0) {
+		// The device refuses mono floats, so take whatever it offers and convert in audioCallback()
+		audioDevice = SDL_OpenAudioDevice(deviceName, 0, &spec, &audioSpec, SDL_AUDIO_ALLOW_ANY_CHANGE);
+	}
+	if (audioDevice <= 0) {
+		audioDevice = 0;
 		return;
+	}
+	audioConvertBuffer.resize(audioSpec.samples);
+	audioLastCallback = 0;
+	audioJitterSmooth = 0.0;
+	audioJitter = 0.0;
+	audioTiming.clear();
+	// The audio thread is stopped, so its state can be reset from here
+	audioFrame = 0;
+	statePublish(0);
+	audioCommandsTail = audioCommandsHead.load();
+	sentAll = false;
+	morphZSentFrame = 0;
 	SDL_PauseAudioDevice(audioDevice, 0);
 }
 
+float audioGetLatency() {
+	if (audioDevice <= 0)
+		return 0.0;
+	return (float) audioSpec.samples / audioSpec.freq;
+}
+
+float audioGetJitter() {
+	return audioJitter;
+}
+
+bool audioGetSpec(int *sampleRate, int *bufferSize, int *channels, int *bits) {
+	if (audioDevice <= 0)
+		return false;
+	*sampleRate = audioSpec.freq;
+	*bufferSize = audioSpec.samples;
+	*channels = audioSpec.channels;
+	*bits = SDL_AUDIO_BITSIZE(audioSpec.format);
+	return true;
+}
+
 void audioInit() {
-	assert(!audioSrc);
-	int err;
-	audioSrc = src_callback_new(srcCallback, SRC_SINC_FASTEST, 1, &err, NULL);
-	assert(audioSrc);
 	audioOpen(-1);
 }
 
 void audioDestroy() {
 	audioClose();
-	src_delete(audioSrc);
 }
@@ -0,0 +1,364 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#if defined ARCH_WIN
+	#include <io.h>
+#else
+	#include <unistd.h>
+	#include <fcntl.h>
+#endif
+
+
+// The bank is saved as autosave.dat plus a journal of the waves changed since.
+// Each journal record is a batch of whole waves with a checksum, so a record torn by a crash is detected and dropped on replay, leaving the bank as of the last complete batch.
+// autosave.dat ends with a generation number which is incremented each time the journal is folded into it. Records carry the generation they apply to, so records already folded in are skipped on replay.
+
+static const char *autosavePath = "autosave.dat";
+static const char *autosaveTmpPath = "autosave.dat.tmp";
+static const char *journalPath = "autosave.journal";
+#define JOURNAL_MAGIC 0x324a4557 // "WEJ2"
+#define AUTOSAVE_MAGIC 0x31474557 // "WEG1"
+/** Seconds between journal writes, which batches the waves changed in the meantime */
+#define JOURNAL_PERIOD 0.5
+/** Journal size at which it is folded into autosave.dat */
+#define JOURNAL_COMPACT_SIZE (4 << 20)
+
+struct JournalHeader {
+	uint32_t magic;
+	/** Generation of the autosave.dat the record applies to */
+	uint32_t generation;
+	uint32_t count;
+	uint32_t checksum;
+};
+
+/** Appended to the bank in autosave.dat. Bank::load() ignores it */
+struct AutosaveTrailer {
+	uint32_t magic;
+	uint32_t generation;
+};
+
+/** The source state of a wave, as stored in the journal */
+struct JournalWave {
+	uint32_t id;
+	float samples[WAVE_LEN];
+	float effects[EFFECTS_LEN];
+	uint8_t cycle;
+	uint8_t normalize;
+	uint8_t padding[2];
+};
+
+// UI thread
+
+/** The waves last handed to the I/O thread */
+static Bank sentBank;
+
+// Shared, guarded by autosaveMutex
+
+static std::mutex autosaveMutex;
+static std::condition_variable autosaveCondition;
+static bool autosaveRunning = false;
+/** Waves changed since the I/O thread last took them */
+static Bank pendingBank;
+static bool pendingDirty[BANK_LEN];
+
+// I/O thread
+
+static std::thread autosaveThread;
+/** The bank as of the end of the journal */
+static Bank savedBank;
+/** Generation of autosave.dat */
+static uint32_t autosaveGeneration = 0;
+static FILE *journalFile = NULL;
+static long journalSize = 0;
+/** Whether the journal may have a torn record after journalSize, which would hide every record appended after it */
+static bool journalTorn = false;
+/** Waves of savedBank which failed to reach the journal, retried with the next record */
+static bool unsavedDirty[BANK_LEN];
+
+
+static bool waveSourceEquals(const Wave *a, const Wave *b) {
+	return memcmp(a->samples, b->samples, sizeof(a->samples)) == 0
+		&& memcmp(a->effects, b->effects, sizeof(a->effects)) == 0
+		&& a->cycle == b->cycle
+		&& a->normalize == b->normalize;
+}
+
+/** FNV-1a */
+static uint32_t checksum(const uint8_t *data, size_t len) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/** Flushes the file and waits until it reaches the disk. Returns false on failure */
+static bool fileSync(FILE *f) {
+	if (fflush(f) != 0)
+		return false;
+#if defined ARCH_WIN
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+/** Waits until renames and deletions in the working directory reach the disk. Returns false on failure */
+static bool dirSync() {
+#if defined ARCH_WIN
+	// Renames are journaled by NTFS, and directories cannot be flushed with the C runtime
+	return true;
+#else
+	int fd = open(".", O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool success = (fsync(fd) == 0);
+	close(fd);
+	return success;
+#endif
+}
+
+/** Cuts the file to `size` bytes. Returns false on failure */
+static bool fileTruncate(const char *path, long size) {
+#if defined ARCH_WIN
+	FILE *f = fopen(path, "r+b");
+	if (!f)
+		return false;
+	bool success = (_chsize(_fileno(f), size) == 0);
+	fclose(f);
+	return success;
+#else
+	return truncate(path, size) == 0;
+#endif
+}
+
+/** Returns the generation of autosave.dat, or 0 if it has none */
+static uint32_t autosaveReadGeneration() {
+	FILE *f = fopen(autosavePath, "rb");
+	if (!f)
+		return 0;
+	AutosaveTrailer trailer;
+	bool found = fseek(f, -(long) sizeof(trailer), SEEK_END) == 0
+		&& fread(&trailer, sizeof(trailer), 1, f) == 1
+		&& trailer.magic == AUTOSAVE_MAGIC;
+	fclose(f);
+	return found ? trailer.generation : 0;
+}
+
+/** Applies the complete records of the journal of generation autosaveGeneration to `bank`, and sets `validSize` to the end of the last record.
+Returns false if there is no journal.
+*/
+static bool journalReplay(Bank *bank, long *validSize) {
+	*validSize = 0;
+	FILE *f = fopen(journalPath, "rb");
+	if (!f)
+		return false;
+
+	bool changed[BANK_LEN] = {};
+	std::vector<JournalWave> waves;
+	while (true) {
+		JournalHeader header;
+		if (fread(&header, sizeof(header), 1, f) != 1)
+			break;
+		if (header.magic != JOURNAL_MAGIC || header.count == 0 || header.count > BANK_LEN)
+			break;
+		waves.resize(header.count);
+		if (fread(waves.data(), sizeof(JournalWave), header.count, f) != header.count)
+			break;
+		if (checksum((const uint8_t*) waves.data(), sizeof(JournalWave) * header.count) != header.checksum)
+			break;
+		*validSize = ftell(f);
+		// Skip records which were folded into autosave.dat before a crash prevented the journal from being removed
+		if (header.generation != autosaveGeneration)
+			continue;
+		for (const JournalWave &journalWave : waves) {
+			if (journalWave.id >= BANK_LEN)
+				continue;
+			Wave *wave = &bank->waves[journalWave.id];
+			memcpy(wave->samples, journalWave.samples, sizeof(wave->samples));
+			memcpy(wave->effects, journalWave.effects, sizeof(wave->effects));
+			wave->cycle = journalWave.cycle;
+			wave->normalize = journalWave.normalize;
+			changed[journalWave.id] = true;
+		}
+	}
+	fclose(f);
+
+	int ids[BANK_LEN];
+	int len = 0;
+	for (int i = 0; i < BANK_LEN; i++) {
+		if (changed[i])
+			ids[len++] = i;
+	}
+	bank->commitSamples(ids, len);
+	return true;
+}
+
+static bool journalCompact();
+
+/** Appends one record with the waves `ids` of savedBank. Returns false if it could not be written */
+static bool journalAppend(const int *ids, int len) {
+	if (journalTorn) {
+		// Cut off the torn record, or else replace the whole journal with autosave.dat
+		if (!fileTruncate(journalPath, journalSize) && !journalCompact())
+			return false;
+		journalTorn = false;
+	}
+	if (!journalFile) {
+		journalFile = fopen(journalPath, "ab");
+		if (!journalFile)
+			return false;
+		fseek(journalFile, 0, SEEK_END);
+		journalSize = ftell(journalFile);
+	}
+
+	// Write the record with a single call, so that a crash tears at most the end of the file
+	std::vector<uint8_t> record(sizeof(JournalHeader) + sizeof(JournalWave) * len);
+	JournalWave *waves = (JournalWave*) &record[sizeof(JournalHeader)];
+	for (int k = 0; k < len; k++) {
+		const Wave *wave = &savedBank.waves[ids[k]];
+		JournalWave *journalWave = &waves[k];
+		memset(journalWave, 0, sizeof(JournalWave));
+		journalWave->id = ids[k];
+		memcpy(journalWave->samples, wave->samples, sizeof(journalWave->samples));
+		memcpy(journalWave->effects, wave->effects, sizeof(journalWave->effects));
+		journalWave->cycle = wave->cycle;
+		journalWave->normalize = wave->normalize;
+	}
+	JournalHeader header;
+	header.magic = JOURNAL_MAGIC;
+	header.generation = autosaveGeneration;
+	header.count = len;
+	header.checksum = checksum((const uint8_t*) waves, sizeof(JournalWave) * len);
+	memcpy(&record[0], &header, sizeof(header));
+
+	if (fwrite(record.data(), 1, record.size(), journalFile) != record.size() || !fileSync(journalFile)) {
+		// Part of the record may have reached the file
+		fprintf(stderr, "Could not write %s\n", journalPath);
+		fclose(journalFile);
+		journalFile = NULL;
+		journalTorn = true;
+		return false;
+	}
+	journalSize += record.size();
+	return true;
+}
+
+/** Writes savedBank to autosave.dat with the next generation and empties the journal. Returns false on failure, leaving the journal as it was.
+The new file replaces the old one only once it is on disk. Until then the journal is replayed over the old file, and afterwards its records are skipped, so a crash at any point leaves the bank of one or the other.
+*/
+static bool journalCompact() {
+	if (!savedBank.save(autosaveTmpPath))
+		return false;
+	FILE *f = fopen(autosaveTmpPath, "ab");
+	if (!f)
+		return false;
+	AutosaveTrailer trailer;
+	trailer.magic = AUTOSAVE_MAGIC;
+	trailer.generation = autosaveGeneration + 1;
+	bool synced = fwrite(&trailer, sizeof(trailer), 1, f) == 1 && fileSync(f);
+	fclose(f);
+	if (!synced)
+		return false;
+	if (!renameReplace(autosaveTmpPath, autosavePath))
+		return false;
+	// Make the rename durable before removing the journal, which holds the only other copy of the changes
+	dirSync();
+	autosaveGeneration++;
+
+	if (journalFile) {
+		fclose(journalFile);
+		journalFile = NULL;
+	}
+	remove(journalPath);
+	journalSize = 0;
+	journalTorn = false;
+	// autosave.dat now holds every wave
+	memset(unsavedDirty, 0, sizeof(unsavedDirty));
+	return true;
+}
+
+static void autosaveRun() {
+	std::unique_lock<std::mutex> lock(autosaveMutex);
+	while (true) {
+		autosaveCondition.wait_for(lock, std::chrono::duration<double>(JOURNAL_PERIOD), [] { return !autosaveRunning; });
+		bool running = autosaveRunning;
+
+		// Take the changed waves
+		for (int i = 0; i < BANK_LEN; i++) {
+			if (pendingDirty[i]) {
+				savedBank.waves[i] = pendingBank.waves[i];
+				pendingDirty[i] = false;
+				unsavedDirty[i] = true;
+			}
+		}
+		lock.unlock();
+
+		int ids[BANK_LEN];
+		int len = 0;
+		for (int i = 0; i < BANK_LEN; i++) {
+			if (unsavedDirty[i])
+				ids[len++] = i;
+		}
+		if (len > 0 && journalAppend(ids, len))
+			memset(unsavedDirty, 0, sizeof(unsavedDirty));
+		if (journalSize >= JOURNAL_COMPACT_SIZE)
+			journalCompact();
+
+		lock.lock();
+		if (!running)
+			break;
+	}
+}
+
+
+void autosaveInit() {
+	currentBank.load(autosavePath);
+	autosaveGeneration = autosaveReadGeneration();
+	long validSize;
+	bool journaled = journalReplay(&currentBank, &validSize);
+	savedBank = currentBank;
+	sentBank = currentBank;
+	if (journaled) {
+		// Fold the journal into autosave.dat. If that fails, a torn record at its end must still be cut off before appending to it.
+		journalSize = validSize;
+		if (!journalCompact())
+			journalTorn = true;
+	}
+
+	autosaveRunning = true;
+	autosaveThread = std::thread(autosaveRun);
+}
+
+void autosaveUpdate() {
+	int ids[BANK_LEN];
+	int len = 0;
+	for (int i = 0; i < BANK_LEN; i++) {
+		const Wave *wave = &currentBank.waves[i];
+		if (!waveSourceEquals(wave, &sentBank.waves[i])) {
+			sentBank.waves[i] = *wave;
+			ids[len++] = i;
+		}
+	}
+	if (len == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(autosaveMutex);
+	for (int k = 0; k < len; k++) {
+		pendingBank.waves[ids[k]] = sentBank.waves[ids[k]];
+		pendingDirty[ids[k]] = true;
+	}
+}
+
+void autosaveDestroy() {
+	autosaveUpdate();
+	{
+		std::lock_guard<std::mutex> lock(autosaveMutex);
+		autosaveRunning = false;
+	}
+	autosaveCondition.notify_one();
+	autosaveThread.join();
+	journalCompact();
+}
@@ -6,9 +6,40 @@
 void Bank::clear() {
 	// The lazy way
 	memset(this, 0, sizeof(Bank));
+	commitSamples();
+}
 
-	for (int i = 0; i < BANK_LEN; i++) {
-		waves[i].commitSamples();
+
+void Bank::commitSamples() {
+	int ids[BANK_LEN];
+	for (int j = 0; j < BANK_LEN; j++) {
+		ids[j] = j;
+	}
+	commitSamples(ids, BANK_LEN);
+}
+
+
+void Bank::commitSamples(const int *ids, int len) {
+	const float *samples[BANK_LEN];
+	float *spectrum[BANK_LEN];
+	const float *postSamples[BANK_LEN];
+	float *postSpectrum[BANK_LEN];
+	for (int k = 0; k < len; k++) {
+		Wave *wave = &waves[ids[k]];
+		samples[k] = wave->samples;
+		spectrum[k] = wave->spectrum;
+		postSamples[k] = wave->postSamples;
+		postSpectrum[k] = wave->postSpectrum;
+	}
+
+	RFFTBatch(samples, spectrum, WAVE_LEN, len);
+	parallelFor(len, [&](int k) {
+		waves[ids[k]].updateHarmonics();
+		waves[ids[k]].updatePostSamples();
+	});
+	RFFTBatch(postSamples, postSpectrum, WAVE_LEN, len);
+	for (int k = 0; k < len; k++) {
+		waves[ids[k]].updatePostHarmonics();
 	}
 }
 
@@ -31,8 +62,40 @@ void Bank::shuffle() {
 void Bank::setSamples(const float *in) {
 	for (int j = 0; j < BANK_LEN; j++) {
 		memcpy(waves[j].samples, &in[j * WAVE_LEN], sizeof(float) * WAVE_LEN);
-		waves[j].commitSamples();
 	}
+	commitSamples();
+}
+
+
+void Bank::updateAllPost() {
+	parallelFor(BANK_LEN, [&](int j) {
+		waves[j].updatePost();
+	});
+}
+
+
+void Bank::clearEffects() {
+	parallelFor(BANK_LEN, [&](int j) {
+		waves[j].clearEffects();
+	});
+}
+
+
+void Bank::bakeEffects() {
+	parallelFor(BANK_LEN, [&](int j) {
+		waves[j].bakeEffects();
+	});
+}
+
+
+void Bank::randomizeEffects() {
+	// rand() is not safe to call from the workers, so pick the parameters here
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < EFFECTS_LEN; i++) {
+			waves[j].effects[i] = randf() > 0.5 ? powf(randf(), 2) : 0.0;
+		}
+	}
+	updateAllPost();
 }
 
 
@@ -52,27 +115,65 @@ void Bank::duplicateToAll(int waveId) {
 }
 
 
-void Bank::save(const char *filename) {
+/** The binary bank format is a dump of the original unaligned Wave struct, so fields are written one at a time to keep old files loadable */
+static void writeWave(const Wave *wave, FILE *f) {
+	fwrite(wave->samples, sizeof(wave->samples), 1, f);
+	fwrite(wave->spectrum, sizeof(wave->spectrum), 1, f);
+	fwrite(wave->harmonics, sizeof(wave->harmonics), 1, f);
+	fwrite(wave->postSamples, sizeof(wave->postSamples), 1, f);
+	fwrite(wave->postSpectrum, sizeof(wave->postSpectrum), 1, f);
+	fwrite(wave->postHarmonics, sizeof(wave->postHarmonics), 1, f);
+	fwrite(wave->effects, sizeof(wave->effects), 1, f);
+	fwrite(&wave->cycle, sizeof(wave->cycle), 1, f);
+	fwrite(&wave->normalize, sizeof(wave->normalize), 1, f);
+	// Struct padding
+	char padding[2] = {};
+	fwrite(padding, sizeof(padding), 1, f);
+}
+
+static void readWave(Wave *wave, FILE *f) {
+	fread(wave->samples, sizeof(wave->samples), 1, f);
+	fread(wave->spectrum, sizeof(wave->spectrum), 1, f);
+	fread(wave->harmonics, sizeof(wave->harmonics), 1, f);
+	fread(wave->postSamples, sizeof(wave->postSamples), 1, f);
+	fread(wave->postSpectrum, sizeof(wave->postSpectrum), 1, f);
+	fread(wave->postHarmonics, sizeof(wave->postHarmonics), 1, f);
+	fread(wave->effects, sizeof(wave->effects), 1, f);
+	fread(&wave->cycle, sizeof(wave->cycle), 1, f);
+	fread(&wave->normalize, sizeof(wave->normalize), 1, f);
+	char padding[2];
+	fread(padding, sizeof(padding), 1, f);
+}
+
+
+bool Bank::save(const char *filename) {
 	FILE *f = fopen(filename, "wb");
 	if (!f)
-		return;
-	fwrite(this, sizeof(*this), 1, f);
-	fclose(f);
+		return false;
+	for (int j = 0; j < BANK_LEN; j++) {
+		writeWave(&waves[j], f);
+	}
+	bool error = ferror(f);
+	if (fclose(f) != 0)
+		error = true;
+	return !error;
 }
 
 
-void Bank::load(const char *filename) {
+bool Bank::load(const char *filename) {
 	clear();
 
 	FILE *f = fopen(filename, "rb");
 	if (!f)
-		return;
-	fread(this, sizeof(*this), 1, f);
-	fclose(f);
-
+		return false;
 	for (int j = 0; j < BANK_LEN; j++) {
-		waves[j].commitSamples();
+		readWave(&waves[j], f);
 	}
+	bool error = ferror(f) || feof(f);
+	fclose(f);
+
+	commitSamples();
+	return !error;
 }
 
 
@@ -93,20 +194,21 @@ void Bank::saveWAV(const char *filename) {
 }
 
 
-void Bank::loadWAV(const char *filename) {
+bool Bank::loadWAV(const char *filename) {
 	clear();
 
 	SF_INFO info;
 	SNDFILE *sf = sf_open(filename, SFM_READ, &info);
 	if (!sf)
-		return;
+		return false;
 
 	for (int i = 0; i < BANK_LEN; i++) {
 		sf_read_float(sf, waves[i].samples, WAVE_LEN);
-		waves[i].commitSamples();
 	}
+	commitSamples();
 
 	sf_close(sf);
+	return true;
 }
 
 
@@ -1,116 +1,682 @@
 #include "WaveEdit.hpp"
 
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#ifdef ARCH_LIN
+	#include <sys/inotify.h>
+	#include <poll.h>
+	#include <unistd.h>
+	#include <map>
+#endif
 
 
-std::vector<CatalogCategory> catalogCategories;
+/** The published catalog, replaced as a whole with std::atomic_store() */
+static std::shared_ptr<const Catalog> catalog = std::make_shared<Catalog>();
+static std::thread catalogThread;
+static std::atomic<bool> catalogRunning(false);
 
+static const char *rootPath = "catalog";
+/** Decoded catalog, so startup doesn't decode every file again */
+static const char *indexPath = "catalog.index";
+static const char *indexTmpPath = "catalog.index.tmp";
+#define INDEX_MAGIC 0x49434557 // "WECI"
+#define INDEX_VERSION 4
+/** Files decoded per parallelFor() call. Other callers of parallelFor() wait for at most one chunk */
+#define DECODE_CHUNK 16
 
-int alphaEntryComp(const void *a, const void *b) {
-	const struct dirent *ad = (const struct dirent *) a;
-	const struct dirent *bd = (const struct dirent *) b;
-	return strcmp(ad->d_name, bd->d_name);
-}
 
-/** Writes entries of directory to `entries` array of length `len`
-Sorts alphabetically, omits entries beginning with "."
-Returns number of entries read
+/** Entries of a directory. Names are stored back to back in one buffer, so a directory of any size costs two allocations */
+struct DirListing {
+	struct Entry {
+		uint32_t offset;
+		bool isDir;
+	};
+	std::vector<char> names;
+	std::vector<Entry> entries;
+
+	const char *name(int i) const {
+		return &names[entries[i].offset];
+	}
+};
+
+/** Lists the regular files and directories of `path`, sorted alphabetically, omitting entries beginning with "."
+Uses the entry type from readdir() where the platform provides it, so stat() is only called for entries of unknown type such as symlinks.
 */
-static int dirEntries(DIR *dir, struct dirent *entries, int len) {
+static void dirList(const char *path, DirListing *listing) {
+	listing->names.clear();
+	listing->entries.clear();
+	DIR *dir = opendir(path);
 	if (!dir)
-		return 0;
+		return;
 
-	int i = 0;
-	while (i < len) {
-		struct dirent *entry = readdir(dir);
-		if (!entry)
-			break;
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
 		// Omit entries beginning with "."
 		if (entry->d_name[0] == '.')
 			continue;
-		entries[i] = *entry;
-		i++;
+
+		bool isDir = false;
+		bool known = false;
+#ifdef DT_DIR
+		if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+			isDir = (entry->d_type == DT_DIR);
+			known = true;
+		}
+#endif
+		if (!known) {
+			char entryPath[PATH_MAX];
+			snprintf(entryPath, sizeof(entryPath), "%s/%s", path, entry->d_name);
+			struct stat entryStat;
+			if (stat(entryPath, &entryStat) != 0)
+				continue;
+			if (!S_ISDIR(entryStat.st_mode) && !S_ISREG(entryStat.st_mode))
+				continue;
+			isDir = S_ISDIR(entryStat.st_mode);
+		}
+
+		DirListing::Entry listingEntry;
+		listingEntry.offset = listing->names.size();
+		listingEntry.isDir = isDir;
+		listing->entries.push_back(listingEntry);
+		size_t len = strlen(entry->d_name);
+		listing->names.insert(listing->names.end(), entry->d_name, entry->d_name + len + 1);
 	}
+	closedir(dir);
 
-	// Sort entries
-	qsort(entries, i, sizeof(struct dirent), alphaEntryComp);
-	return i;
+	const char *names = listing->names.data();
+	std::sort(listing->entries.begin(), listing->entries.end(), [names](const DirListing::Entry &a, const DirListing::Entry &b) {
+		return strcmp(&names[a.offset], &names[b.offset]) < 0;
+	});
 }
 
+/** Returns the display name of a file or directory, without digits at the beginning or the extension
+e.g. "00Digital" -> "Digital"
+*/
+static std::string displayName(const char *filename) {
+	const char *name = filename;
+	while (isdigit(*name))
+		name++;
 
-void catalogInit() {
-	static const char *rootPath = "catalog";
-	DIR *rootDir = opendir(rootPath);
-	struct dirent categoryEntries[128];
-	int categoriesLength = dirEntries(rootDir, categoryEntries, 128);
+	// Find first period
+	const char *period = name;
+	while (*period != '\0' && *period != '.')
+		period++;
+	return std::string(name, period - name);
+}
 
-	for (int i = 0; i < categoriesLength; i++) {
-		char categoryPath[PATH_MAX];
-		snprintf(categoryPath, sizeof(categoryPath), "%s/%s", rootPath, categoryEntries[i].d_name);
+/** Decodes the file at `filePath` into `catalogFile`. Returns false if it isn't a single cycle wave */
+static bool decodeFile(const char *filePath, const char *filename, CatalogFile *catalogFile) {
+	catalogFile->filename = filename;
+	catalogFile->name = displayName(filename);
 
-		// Directories only
-		struct stat categoryStat;
-		stat(categoryPath, &categoryStat);
-		if (!S_ISDIR(categoryStat.st_mode))
-			continue;
+	int length;
+	float *samples = loadAudio(filePath, &length);
+	if (!samples)
+		return false;
+	bool valid = (length == WAVE_LEN);
+	if (valid)
+		memcpy(catalogFile->samples, samples, sizeof(float) * WAVE_LEN);
+	else
+		printf("%s has length %d but needs %d\n", filePath, length, WAVE_LEN);
+	delete[] samples;
+	return valid;
+}
+
+#ifdef ARCH_LIN
+// Every catalog directory is watched with inotify, starting before it is listed so that no change is missed.
 
-		// Skip digits at beginning of filename
-		// e.g. "00Digital" -> "Digital"
-		const char *name = categoryEntries[i].d_name;
-		while (isdigit(*name))
-			name++;
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
 
-		CatalogCategory catalogCategory;
-		catalogCategory.name = name;
+/** inotify instance of the catalog thread, or -1 */
+static int watchFd = -1;
+/** Directories watched, relative to rootPath, by watch descriptor. The root is "" */
+static std::map<int, std::string> watches;
 
-		DIR *categoryDir = opendir(categoryPath);
-		struct dirent fileEntries[128];
-		int filesLength = dirEntries(categoryDir, fileEntries, 128);
+/** Watches a directory, or updates its path if it is already watched */
+static void watchAdd(const std::string &path) {
+	if (watchFd < 0)
+		return;
+	std::string dirPath = path.empty() ? std::string(rootPath) : std::string(rootPath) + "/" + path;
+	int wd = inotify_add_watch(watchFd, dirPath.c_str(), WATCH_MASK);
+	if (wd >= 0)
+		watches[wd] = path;
+}
+#endif
+
+/** A directory read while scanning, for validating the index */
+struct IndexDir {
+	/** Relative to rootPath */
+	std::string path;
+	int64_t mtime;
+};
+
+/** Reads the waves of a category directory, decoding them across the worker threads, and the nested directories as subcategories.
+Appends the directories read to `dirs`.
+*/
+static void scanCategory(const std::string &path, CatalogCategory *catalogCategory, std::vector<IndexDir> *dirs) {
+#ifdef ARCH_LIN
+	// Changes made after this are seen as events, even those which the listing below also sees. Applying them again is harmless.
+	watchAdd(path);
+#endif
+	// Take the mtime before listing, so a change during the scan is noticed next time
+	IndexDir indexDir;
+	indexDir.path = path;
+	indexDir.mtime = 0;
+	std::string dirPath = std::string(rootPath) + "/" + path;
+	struct stat dirStat;
+	if (stat(dirPath.c_str(), &dirStat) == 0) {
+		indexDir.mtime = dirStat.st_mtime;
+		// mtimes have a resolution of a second, so a directory changed within the last couple of seconds may change again unnoticed. Index it as unknown so it's scanned next time.
+		if (time(NULL) - indexDir.mtime < 2)
+			indexDir.mtime = 0;
+	}
+	dirs->push_back(indexDir);
 
-		for (int j = 0; j < filesLength; j++) {
+	DirListing listing;
+	dirList(dirPath.c_str(), &listing);
+	std::vector<int> fileIds;
+	for (int i = 0; i < (int) listing.entries.size(); i++) {
+		if (!listing.entries[i].isDir)
+			fileIds.push_back(i);
+	}
+
+	// Each file is decoded into its own slot, so the alphabetical order holds regardless of which worker finishes first
+	int filesLength = fileIds.size();
+	std::vector<CatalogFile> files(filesLength);
+	std::vector<char> valid(filesLength, false);
+	for (int j = 0; j < filesLength && catalogRunning; j += DECODE_CHUNK) {
+		parallelFor(mini(DECODE_CHUNK, filesLength - j), [&](int k) {
+			const char *filename = listing.name(fileIds[j + k]);
 			char filePath[PATH_MAX];
-			snprintf(filePath, sizeof(filePath), "%s/%s", categoryPath, fileEntries[j].d_name);
+			snprintf(filePath, sizeof(filePath), "%s/%s", dirPath.c_str(), filename);
+			valid[j + k] = decodeFile(filePath, filename, &files[j + k]);
+		});
+	}
+	for (int j = 0; j < filesLength; j++) {
+		if (valid[j])
+			catalogCategory->files.push_back(std::move(files[j]));
+	}
 
-			// Regular files only
-			// Directories only
-			struct stat fileStat;
-			stat(filePath, &fileStat);
-			if (!S_ISREG(fileStat.st_mode))
-				continue;
+	for (int i = 0; i < (int) listing.entries.size() && catalogRunning; i++) {
+		if (!listing.entries[i].isDir)
+			continue;
+		CatalogCategory subcategory;
+		subcategory.dirName = listing.name(i);
+		subcategory.name = displayName(listing.name(i));
+		scanCategory(path + "/" + listing.name(i), &subcategory, dirs);
+		// Empty subcategories are kept, so waves added to them later have a place, and hidden by the UI
+		catalogCategory->subcategories.push_back(std::move(subcategory));
+	}
+}
+
+bool CatalogCategory::empty() const {
+	if (!files.empty())
+		return false;
+	for (const CatalogCategory &subcategory : subcategories) {
+		if (!subcategory.empty())
+			return false;
+	}
+	return true;
+}
+
+/** Appends a category to a copy of the catalog and publishes it */
+static void catalogPublish(const std::shared_ptr<const CatalogCategory> &category) {
+	std::shared_ptr<Catalog> next = std::make_shared<Catalog>(*std::atomic_load(&catalog));
+	next->push_back(category);
+	std::atomic_store(&catalog, std::shared_ptr<const Catalog>(next));
+}
+
+
+// Index file.
+// The header is followed by each category: the mtime of each directory in it, then the category's directory name, display name, files and subcategories, recursively.
+// Strings are a uint32 length and the bytes.
+// A category is reused while none of its directory mtimes have changed, since adding, removing or renaming files or directories changes the mtime of the directory containing them.
+
+struct IndexCategory {
+	std::vector<IndexDir> dirs;
+	CatalogCategory category;
+};
+
+/** Nesting deeper than this in the index is treated as corrupt */
+#define INDEX_DEPTH_MAX 32
+
+/** Bounds-checked reads from the index buffer */
+struct IndexReader {
+	const char *p;
+	const char *end;
+
+	bool read(void *out, size_t len) {
+		if ((size_t) (end - p) < len)
+			return false;
+		memcpy(out, p, len);
+		p += len;
+		return true;
+	}
+	bool readString(std::string *s) {
+		uint32_t len;
+		if (!read(&len, sizeof(len)) || (size_t) (end - p) < len)
+			return false;
+		s->assign(p, len);
+		p += len;
+		return true;
+	}
+	/** Reads a count of items which take at least `size` bytes each, so that a corrupt count can't cause a huge allocation */
+	bool readCount(uint32_t *count, size_t size) {
+		return read(count, sizeof(*count)) && *count <= (size_t) (end - p) / size;
+	}
+	bool readCategory(CatalogCategory *category, int depth) {
+		uint32_t filesLen;
+		if (depth > INDEX_DEPTH_MAX || !readString(&category->dirName) || !readString(&category->name) || !readCount(&filesLen, sizeof(float) * WAVE_LEN))
+			return false;
+		category->files.resize(filesLen);
+		for (CatalogFile &catalogFile : category->files) {
+			if (!readString(&catalogFile.filename) || !readString(&catalogFile.name) || !read(catalogFile.samples, sizeof(catalogFile.samples)))
+				return false;
+		}
+		uint32_t subcategoriesLen;
+		if (!readCount(&subcategoriesLen, 3 * sizeof(uint32_t)))
+			return false;
+		category->subcategories.resize(subcategoriesLen);
+		for (CatalogCategory &subcategory : category->subcategories) {
+			if (!readCategory(&subcategory, depth + 1))
+				return false;
+		}
+		return true;
+	}
+};
+
+static void writeString(const std::string &s, std::vector<char> &out) {
+	uint32_t len = s.size();
+	out.insert(out.end(), (const char*) &len, (const char*) &len + sizeof(len));
+	out.insert(out.end(), s.begin(), s.end());
+}
+
+static void writeValue(const void *data, size_t len, std::vector<char> &out) {
+	out.insert(out.end(), (const char*) data, (const char*) data + len);
+}
+
+static void writeCategory(const CatalogCategory &category, std::vector<char> &out) {
+	writeString(category.dirName, out);
+	writeString(category.name, out);
+	uint32_t filesLen = category.files.size();
+	writeValue(&filesLen, sizeof(filesLen), out);
+	for (const CatalogFile &catalogFile : category.files) {
+		writeString(catalogFile.filename, out);
+		writeString(catalogFile.name, out);
+		writeValue(catalogFile.samples, sizeof(catalogFile.samples), out);
+	}
+	uint32_t subcategoriesLen = category.subcategories.size();
+	writeValue(&subcategoriesLen, sizeof(subcategoriesLen), out);
+	for (const CatalogCategory &subcategory : category.subcategories) {
+		writeCategory(subcategory, out);
+	}
+}
+
+/** Reads the index with a single read. Returns false if it is missing or malformed */
+static bool indexLoad(std::vector<IndexCategory> &categories) {
+	FILE *f = fopen(indexPath, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	std::vector<char> data(size > 0 ? size : 0);
+	bool ok = (size > 0) && fread(data.data(), 1, size, f) == (size_t) size;
+	fclose(f);
+	if (!ok)
+		return false;
+
+	IndexReader reader;
+	reader.p = data.data();
+	reader.end = data.data() + data.size();
+	uint32_t header[3];
+	if (!reader.read(header, sizeof(header)) || header[0] != INDEX_MAGIC || header[1] != INDEX_VERSION)
+		return false;
+	categories.resize(header[2]);
+	for (IndexCategory &indexCategory : categories) {
+		uint32_t dirsLen;
+		if (!reader.readCount(&dirsLen, sizeof(uint32_t) + sizeof(int64_t)))
+			return false;
+		indexCategory.dirs.resize(dirsLen);
+		for (IndexDir &indexDir : indexCategory.dirs) {
+			if (!reader.readString(&indexDir.path) || !reader.read(&indexDir.mtime, sizeof(indexDir.mtime)))
+				return false;
+		}
+		if (!reader.readCategory(&indexCategory.category, 0))
+			return false;
+	}
+	return true;
+}
+
+static void indexSave(const std::vector<IndexCategory> &categories) {
+	std::vector<char> data;
+	uint32_t header[3] = {INDEX_MAGIC, INDEX_VERSION, (uint32_t) categories.size()};
+	writeValue(header, sizeof(header), data);
+	for (const IndexCategory &indexCategory : categories) {
+		uint32_t dirsLen = indexCategory.dirs.size();
+		writeValue(&dirsLen, sizeof(dirsLen), data);
+		for (const IndexDir &indexDir : indexCategory.dirs) {
+			writeString(indexDir.path, data);
+			writeValue(&indexDir.mtime, sizeof(indexDir.mtime), data);
+		}
+		writeCategory(indexCategory.category, data);
+	}
+
+	// Replace the index only once it is completely written, so a crash or a full disk can't leave a torn index
+	FILE *f = fopen(indexTmpPath, "wb");
+	if (!f)
+		return;
+	bool error = fwrite(data.data(), 1, data.size(), f) != data.size();
+	if (fclose(f) != 0)
+		error = true;
+	if (error || !renameReplace(indexTmpPath, indexPath)) {
+		fprintf(stderr, "Could not write %s\n", indexPath);
+		remove(indexTmpPath);
+	}
+}
+
+/** Returns whether the directories of an indexed category are unchanged, with one stat() per directory */
+static bool indexValid(const IndexCategory &indexCategory) {
+	if (indexCategory.dirs.empty())
+		return false;
+	for (const IndexDir &indexDir : indexCategory.dirs) {
+		std::string dirPath = std::string(rootPath) + "/" + indexDir.path;
+		struct stat dirStat;
+		if (stat(dirPath.c_str(), &dirStat) != 0 || (int64_t) dirStat.st_mtime != indexDir.mtime)
+			return false;
+	}
+	return true;
+}
+
+
+#ifdef ARCH_LIN
+// Live updates.
+// After the initial scan, the catalog thread applies the events of the watched directories to copies of only the affected categories, and publishes the result like the initial scan.
+
+/** Stops watching a directory and the directories inside it, which keep their watches if moved elsewhere */
+static void watchRemove(const std::string &path) {
+	for (auto it = watches.begin(); it != watches.end();) {
+		const std::string &watchPath = it->second;
+		if (watchPath == path || watchPath.compare(0, path.size() + 1, path + "/") == 0) {
+			inotify_rm_watch(watchFd, it->first);
+			it = watches.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+/** Scans a directory which appeared in the catalog, which also watches it and its subdirectories */
+static void watchScan(const std::string &path, CatalogCategory *category) {
+	std::vector<IndexDir> dirs;
+	scanCategory(path, category, &dirs);
+}
+
+/** Top-level categories copied for editing in the current batch, by directory name */
+typedef std::map<std::string, std::shared_ptr<CatalogCategory>> EditedCategories;
+
+/** Returns the category at the relative directory `path` in `next`, copying its top-level category on its first edit so the published one stays untouched.
+Returns NULL if there is no such category.
+*/
+static CatalogCategory *editCategory(Catalog &next, EditedCategories &edited, const std::string &path) {
+	size_t slash = path.find('/');
+	std::string dirName = path.substr(0, slash);
+	CatalogCategory *category = NULL;
+	auto it = edited.find(dirName);
+	if (it != edited.end()) {
+		category = it->second.get();
+	}
+	else {
+		for (std::shared_ptr<const CatalogCategory> &topCategory : next) {
+			if (topCategory->dirName == dirName) {
+				std::shared_ptr<CatalogCategory> copy = std::make_shared<CatalogCategory>(*topCategory);
+				topCategory = copy;
+				edited[dirName] = copy;
+				category = copy.get();
+				break;
+			}
+		}
+	}
 
-			// Get the name without digits at the beginning
-			const char *name = fileEntries[j].d_name;
-			while (isdigit(*name))
-				name++;
+	// Descend into subcategories
+	while (category && slash != std::string::npos) {
+		size_t start = slash + 1;
+		slash = path.find('/', start);
+		std::string subdirName = path.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+		CatalogCategory *subcategory = NULL;
+		for (CatalogCategory &c : category->subcategories) {
+			if (c.dirName == subdirName)
+				subcategory = &c;
+		}
+		category = subcategory;
+	}
+	return category;
+}
 
-			// Find first period
-			const char *period = name;
-			while (*period != '\0' && *period != '.')
-				period++;
+/** Applies one event to `next`. Returns whether the catalog changed */
+static bool watchApply(const struct inotify_event *event, Catalog &next, EditedCategories &edited) {
+	if (event->mask & IN_IGNORED) {
+		watches.erase(event->wd);
+		return false;
+	}
+	if (event->len == 0 || event->name[0] == '.')
+		return false;
+	auto it = watches.find(event->wd);
+	if (it == watches.end())
+		return false;
 
+	std::string dir = it->second;
+	std::string name = event->name;
+	std::string path = dir.empty() ? name : dir + "/" + name;
+	bool isDir = event->mask & IN_ISDIR;
+	// Files are read once written, not when created
+	if (!isDir && (event->mask & IN_CREATE))
+		return false;
+	bool added = event->mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO);
+	bool removed = event->mask & (IN_DELETE | IN_MOVED_FROM);
+	if (!added && !removed)
+		return false;
+
+	if (dir.empty()) {
+		// Top-level categories. Files directly in the catalog directory are not waves.
+		if (!isDir)
+			return false;
+		if (removed)
+			watchRemove(path);
+		edited.erase(name);
+		for (auto c = next.begin(); c != next.end(); c++) {
+			if ((*c)->dirName == name) {
+				next.erase(c);
+				break;
+			}
+		}
+		if (added) {
+			std::shared_ptr<CatalogCategory> category = std::make_shared<CatalogCategory>();
+			category->dirName = name;
+			category->name = displayName(name.c_str());
+			watchScan(path, category.get());
+			auto position = std::lower_bound(next.begin(), next.end(), name, [](const std::shared_ptr<const CatalogCategory> &c, const std::string &n) {
+				return c->dirName < n;
+			});
+			next.insert(position, category);
+		}
+		return true;
+	}
+
+	CatalogCategory *category = editCategory(next, edited, dir);
+	if (!category)
+		return false;
+
+	if (isDir) {
+		if (removed)
+			watchRemove(path);
+		std::vector<CatalogCategory> &subcategories = category->subcategories;
+		for (auto c = subcategories.begin(); c != subcategories.end(); c++) {
+			if (c->dirName == name) {
+				subcategories.erase(c);
+				break;
+			}
+		}
+		if (added) {
+			CatalogCategory subcategory;
+			subcategory.dirName = name;
+			subcategory.name = displayName(name.c_str());
+			watchScan(path, &subcategory);
+			auto position = std::lower_bound(subcategories.begin(), subcategories.end(), name, [](const CatalogCategory &c, const std::string &n) {
+				return c.dirName < n;
+			});
+			subcategories.insert(position, std::move(subcategory));
+		}
+	}
+	else {
+		std::vector<CatalogFile> &files = category->files;
+		for (auto f = files.begin(); f != files.end(); f++) {
+			if (f->filename == name) {
+				files.erase(f);
+				break;
+			}
+		}
+		if (added) {
 			CatalogFile catalogFile;
-			catalogFile.name = std::string(name, period - name);
-
-			int length;
-			float *samples = loadAudio(filePath, &length);
-			if (samples) {
-				if (length == WAVE_LEN) {
-					memcpy(catalogFile.samples, samples, sizeof(float) * WAVE_LEN);
-					catalogCategory.files.push_back(catalogFile);
+			std::string filePath = std::string(rootPath) + "/" + path;
+			if (decodeFile(filePath.c_str(), name.c_str(), &catalogFile)) {
+				auto position = std::lower_bound(files.begin(), files.end(), name, [](const CatalogFile &f, const std::string &n) {
+					return f.filename < n;
+				});
+				files.insert(position, std::move(catalogFile));
+			}
+		}
+	}
+	return true;
+}
+
+/** Applies changes to the catalog directories until catalogDestroy(), including those made during the initial scan */
+static void catalogWatch() {
+	alignas(struct inotify_event) char buffer[1 << 16];
+	while (catalogRunning) {
+		// Time out to notice catalogDestroy()
+		struct pollfd pfd;
+		pfd.fd = watchFd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 250) <= 0)
+			continue;
+		// Let a burst of changes settle, such as a folder of waves being copied, so it is published once
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		std::shared_ptr<Catalog> next = std::make_shared<Catalog>(*catalogGet());
+		EditedCategories edited;
+		bool changed = false;
+		while (true) {
+			ssize_t len = read(watchFd, buffer, sizeof(buffer));
+			if (len <= 0)
+				break;
+			for (char *p = buffer; p < buffer + len;) {
+				const struct inotify_event *event = (const struct inotify_event*) p;
+				if (event->mask & IN_Q_OVERFLOW)
+					printf("Catalog changes were lost, restart to see them\n");
+				if (watchApply(event, *next, edited))
+					changed = true;
+				p += sizeof(struct inotify_event) + event->len;
+			}
+		}
+
+		if (changed) {
+			std::atomic_store(&catalog, std::shared_ptr<const Catalog>(next));
+			similarBuild(next);
+		}
+	}
+}
+#endif
+
+
+/** Scans the catalog in alphabetical order, publishing each category as it completes */
+static void catalogRun() {
+	std::vector<IndexCategory> cached;
+	// A category which failed to load partway holds files with no names or samples
+	if (!indexLoad(cached))
+		cached.clear();
+	std::vector<IndexCategory> categories;
+	bool changed = false;
+
+#ifdef ARCH_LIN
+	watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	watchAdd("");
+#endif
+	DirListing listing;
+	dirList(rootPath, &listing);
+
+	for (int i = 0; i < (int) listing.entries.size() && catalogRunning; i++) {
+		// Directories only
+		if (!listing.entries[i].isDir)
+			continue;
+
+		IndexCategory indexCategory;
+		indexCategory.category.dirName = listing.name(i);
+
+		// Reuse the indexed category if its directories haven't changed
+		bool found = false;
+		for (IndexCategory &cachedCategory : cached) {
+			if (cachedCategory.category.dirName == indexCategory.category.dirName) {
+#ifdef ARCH_LIN
+				// Watch before validating, so a change right after validation is still seen
+				for (const IndexDir &indexDir : cachedCategory.dirs) {
+					watchAdd(indexDir.path);
 				}
-				else {
-					printf("%s has length %d but needs %d\n", filePath, length, WAVE_LEN);
+#endif
+				if (indexValid(cachedCategory)) {
+					indexCategory = std::move(cachedCategory);
+					found = true;
 				}
-				delete[] samples;
+				break;
 			}
 		}
 
-		catalogCategories.push_back(catalogCategory);
-		closedir(categoryDir);
+		if (!found) {
+			indexCategory.category.name = displayName(listing.name(i));
+			scanCategory(indexCategory.category.dirName, &indexCategory.category, &indexCategory.dirs);
+			if (!catalogRunning)
+				break;
+			changed = true;
+		}
+		catalogPublish(std::make_shared<CatalogCategory>(indexCategory.category));
+		categories.push_back(std::move(indexCategory));
+	}
+
+	// Removed categories also change the index
+	if (catalogRunning && (changed || categories.size() != cached.size()))
+		indexSave(categories);
+	if (catalogRunning)
+		similarBuild(catalogGet());
+
+#ifdef ARCH_LIN
+	if (watchFd >= 0) {
+		if (catalogRunning)
+			catalogWatch();
+		close(watchFd);
+		watchFd = -1;
+		watches.clear();
 	}
+#endif
+}
+
+
+std::shared_ptr<const Catalog> catalogGet() {
+	return std::atomic_load(&catalog);
+}
+
+void catalogInit() {
+	catalogRunning = true;
+	catalogThread = std::thread(catalogRun);
+}
 
-	closedir(rootDir);
+void catalogDestroy() {
+	catalogRunning = false;
+	if (catalogThread.joinable())
+		catalogThread.join();
 }
@@ -1,14 +1,275 @@
 #include "WaveEdit.hpp"
 #include <SDL.h>
+#include <string.h>
+#include <memory>
+#include <deque>
 
 
 Bank currentBank;
+int historyBudget = 16 << 20;
 
-static std::vector<Bank> history;
+/** The state of a wave which the user edits. Everything else in Wave is derived from it, so history only stores this, about a fifth of the size */
+struct WaveSource {
+	float samples[WAVE_LEN];
+	float effects[EFFECTS_LEN];
+	bool cycle;
+	bool normalize;
+
+	void get(const Wave *wave) {
+		memcpy(samples, wave->samples, sizeof(samples));
+		memcpy(effects, wave->effects, sizeof(effects));
+		cycle = wave->cycle;
+		normalize = wave->normalize;
+	}
+	void set(Wave *wave) const {
+		memcpy(wave->samples, samples, sizeof(samples));
+		memcpy(wave->effects, effects, sizeof(effects));
+		wave->cycle = cycle;
+		wave->normalize = normalize;
+	}
+	bool equals(const Wave *wave) const {
+		return memcmp(samples, wave->samples, sizeof(samples)) == 0
+			&& memcmp(effects, wave->effects, sizeof(effects)) == 0
+			&& cycle == wave->cycle
+			&& normalize == wave->normalize;
+	}
+};
+
+/** Immutable source of a wave. Entries share a block for as long as the wave doesn't change, so each push only stores the waves that were edited */
+typedef std::shared_ptr<const WaveSource> WaveBlock;
+
+struct HistoryEntry {
+	WaveBlock waves[BANK_LEN];
+};
+
+/** Bytes of WaveSource blocks alive */
+static size_t historyBytes = 0;
+/** Entries in memory. history[k] is entry journal.size() + k */
+static std::deque<HistoryEntry> history;
+/** Index of the current entry, counting entries in the journal */
 static int currentIndex = -1;
 static double previousTime = -INFINITY;
 static const double delayTime = 0.2;
 
+// Undo journal.
+// When the blocks in memory exceed historyBudget, the oldest entries are moved to a file, each stored as the XOR of its bytes with the entry before it, compressed by run length.
+// Unchanged waves XOR to zeros, so an entry costs little more than the waves that were edited.
+// Every HISTORY_KEYFRAME_INTERVAL entries is stored whole, so reading any entry decodes a bounded number of records.
+
+#define HISTORY_KEYFRAME_INTERVAL 32
+#define HISTORY_STATE_SIZE (BANK_LEN * sizeof(WaveSource))
+static const char *journalPath = "history.dat";
+
+struct JournalRecord {
+	long offset;
+	uint32_t size;
+};
+
+/** Entries moved to the journal, oldest first */
+static std::vector<JournalRecord> journal;
+static FILE *journalFile = NULL;
+static long journalEnd = 0;
+/** The last entry written to the journal, which the next record is relative to */
+static HistoryEntry journalLast;
+/** The entry last read back from the journal, and its bytes */
+static HistoryEntry journalCache;
+static int journalCacheIndex = -1;
+static std::vector<uint8_t> journalCacheState;
+
+
+static std::shared_ptr<WaveSource> waveSourceNew() {
+	historyBytes += sizeof(WaveSource);
+	// Value initialization zeros the padding, so the bytes of equal sources are equal
+	return std::shared_ptr<WaveSource>(new WaveSource(), [](WaveSource *source) {
+		historyBytes -= sizeof(WaveSource);
+		delete source;
+	});
+}
+
+static void entryToState(const HistoryEntry &entry, uint8_t *state) {
+	for (int i = 0; i < BANK_LEN; i++) {
+		memcpy(&state[i * sizeof(WaveSource)], entry.waves[i].get(), sizeof(WaveSource));
+	}
+}
+
+static void stateToEntry(const uint8_t *state, HistoryEntry *entry) {
+	for (int i = 0; i < BANK_LEN; i++) {
+		std::shared_ptr<WaveSource> source = waveSourceNew();
+		memcpy(source.get(), &state[i * sizeof(WaveSource)], sizeof(WaveSource));
+		entry->waves[i] = source;
+	}
+}
+
+/** Run length encoding of zero bytes. Each run is a uint16 count of zeros, a uint16 count of literals, and the literal bytes */
+static void rleEncode(const uint8_t *in, int len, std::vector<uint8_t> &out) {
+	out.clear();
+	int i = 0;
+	while (i < len) {
+		int zeros = 0;
+		while (i + zeros < len && zeros < 0xffff && in[i + zeros] == 0)
+			zeros++;
+		i += zeros;
+		// Literals end at a run of 4 zeros, which is what a run header costs
+		int literals = 0;
+		while (i + literals < len && literals < 0xffff) {
+			if (in[i + literals] == 0) {
+				int z = 0;
+				while (z < 4 && i + literals + z < len && in[i + literals + z] == 0)
+					z++;
+				if (z == 4 || i + literals + z == len)
+					break;
+			}
+			literals++;
+		}
+		uint16_t header[2] = {(uint16_t) zeros, (uint16_t) literals};
+		out.insert(out.end(), (const uint8_t*) header, (const uint8_t*) header + sizeof(header));
+		out.insert(out.end(), &in[i], &in[i + literals]);
+		i += literals;
+	}
+}
+
+/** XORs the decoded bytes into `state`. Returns false if the data is malformed */
+static bool rleDecodeXor(const uint8_t *in, int inLen, uint8_t *state, int len) {
+	int i = 0;
+	int j = 0;
+	while (j + 4 <= inLen) {
+		uint16_t header[2];
+		memcpy(header, &in[j], sizeof(header));
+		j += sizeof(header);
+		i += header[0];
+		if (i + header[1] > len || j + header[1] > inLen)
+			return false;
+		for (int k = 0; k < header[1]; k++) {
+			state[i + k] ^= in[j + k];
+		}
+		i += header[1];
+		j += header[1];
+	}
+	return j == inLen;
+}
+
+/** Moves the oldest entry in memory to the journal. Returns false if the journal can't be written */
+static bool journalWrite() {
+	if (!journalFile) {
+		journalFile = fopen(journalPath, "w+b");
+		if (!journalFile)
+			return false;
+		journalEnd = 0;
+	}
+
+	const HistoryEntry &entry = history.front();
+	bool keyframe = (journal.size() % HISTORY_KEYFRAME_INTERVAL == 0);
+	std::vector<uint8_t> state(HISTORY_STATE_SIZE);
+	entryToState(entry, state.data());
+	if (!keyframe) {
+		std::vector<uint8_t> last(HISTORY_STATE_SIZE);
+		entryToState(journalLast, last.data());
+		for (int k = 0; k < (int) HISTORY_STATE_SIZE; k++) {
+			state[k] ^= last[k];
+		}
+	}
+	std::vector<uint8_t> data;
+	rleEncode(state.data(), HISTORY_STATE_SIZE, data);
+
+	fseek(journalFile, journalEnd, SEEK_SET);
+	if (fwrite(data.data(), 1, data.size(), journalFile) != data.size())
+		return false;
+	JournalRecord record;
+	record.offset = journalEnd;
+	record.size = data.size();
+	journal.push_back(record);
+	journalEnd += data.size();
+
+	journalLast = entry;
+	history.pop_front();
+	return true;
+}
+
+/** Decodes entry `index` from the journal into journalCache */
+static bool journalRead(int index) {
+	if (journalCacheIndex == index)
+		return true;
+	fflush(journalFile);
+	// Continue from the cached entry if it is on the way, or else from the last keyframe
+	int start = index - index % HISTORY_KEYFRAME_INTERVAL;
+	if (journalCacheIndex >= start && journalCacheIndex < index)
+		start = journalCacheIndex + 1;
+	else
+		journalCacheState.assign(HISTORY_STATE_SIZE, 0);
+	journalCacheIndex = -1;
+
+	std::vector<uint8_t> data;
+	for (int k = start; k <= index; k++) {
+		const JournalRecord &record = journal[k];
+		data.resize(record.size);
+		fseek(journalFile, record.offset, SEEK_SET);
+		if (fread(data.data(), 1, record.size, journalFile) != record.size)
+			return false;
+		if (k % HISTORY_KEYFRAME_INTERVAL == 0)
+			journalCacheState.assign(HISTORY_STATE_SIZE, 0);
+		if (!rleDecodeXor(data.data(), record.size, journalCacheState.data(), HISTORY_STATE_SIZE))
+			return false;
+	}
+	stateToEntry(journalCacheState.data(), &journalCache);
+	journalCacheIndex = index;
+	return true;
+}
+
+static int historyLength() {
+	return journal.size() + history.size();
+}
+
+/** Returns NULL if the entry can't be read from the journal */
+static const HistoryEntry *historyGet(int index) {
+	int journalLen = journal.size();
+	if (index >= journalLen)
+		return &history[index - journalLen];
+	if (!journalRead(index))
+		return NULL;
+	return &journalCache;
+}
+
+/** Deletes entry `index` and every entry after it.
+If the entry before it can't be read from the journal, the journal is deleted too, and currentIndex is shifted to match.
+*/
+static void historyTruncate(int index) {
+	int journalLen = journal.size();
+	if (index >= journalLen) {
+		history.resize(index - journalLen);
+		return;
+	}
+	history.clear();
+	if (journalCacheIndex >= index)
+		journalCacheIndex = -1;
+	if (index >= 1 && journalRead(index - 1)) {
+		journalLast = journalCache;
+		journalEnd = journal[index].offset;
+		journal.resize(index);
+	}
+	else {
+		// Without the last kept entry, the next record can't be a delta, so drop the journal and start over with a keyframe
+		journalCacheIndex = -1;
+		journalLast = HistoryEntry();
+		journalEnd = 0;
+		journal.clear();
+		currentIndex -= index;
+	}
+}
+
+/** Sets currentBank to an entry, recomputing the derived arrays of the waves which changed in one batch */
+static void historyRestore(const HistoryEntry &entry) {
+	int ids[BANK_LEN];
+	int len = 0;
+	for (int i = 0; i < BANK_LEN; i++) {
+		const WaveSource *source = entry.waves[i].get();
+		if (!source->equals(&currentBank.waves[i])) {
+			source->set(&currentBank.waves[i]);
+			ids[len++] = i;
+		}
+	}
+	currentBank.commitSamples(ids, len);
+}
+
 
 void historyPush() {
 	double time = SDL_GetTicks() / 1000.0;
@@ -16,31 +277,81 @@ void historyPush() {
 		currentIndex++;
 	}
 
+	// Share blocks with the entry being replaced, or else with the previous entry
+	const HistoryEntry *reference = NULL;
+	if (currentIndex < historyLength())
+		reference = historyGet(currentIndex);
+	else if (currentIndex >= 1)
+		reference = historyGet(currentIndex - 1);
+
+	HistoryEntry entry;
+	for (int i = 0; i < BANK_LEN; i++) {
+		const Wave *wave = &currentBank.waves[i];
+		if (reference && reference->waves[i]->equals(wave)) {
+			entry.waves[i] = reference->waves[i];
+		}
+		else {
+			std::shared_ptr<WaveSource> source = waveSourceNew();
+			source->get(wave);
+			entry.waves[i] = source;
+		}
+	}
+
 	// Delete redo history
-	history.resize(currentIndex + 1);
+	if (currentIndex < historyLength())
+		historyTruncate(currentIndex);
 
-	history[currentIndex] = currentBank;
+	history.push_back(entry);
 	previousTime = time;
+
+	// Keep at least the newest entry in memory
+	while (historyBytes > (size_t) historyBudget && history.size() > 1) {
+		if (!journalWrite())
+			break;
+	}
 }
 
 void historyUndo() {
 	if (currentIndex >= 1) {
+		const HistoryEntry *entry = historyGet(currentIndex - 1);
+		if (!entry)
+			return;
 		currentIndex--;
-		currentBank = history[currentIndex];
+		historyRestore(*entry);
 		previousTime = -INFINITY;
 	}
 }
 
 void historyRedo() {
-	if ((int) history.size() > currentIndex + 1) {
+	if (historyLength() > currentIndex + 1) {
+		const HistoryEntry *entry = historyGet(currentIndex + 1);
+		if (!entry)
+			return;
 		currentIndex++;
-		currentBank = history[currentIndex];
+		historyRestore(*entry);
 		previousTime = -INFINITY;
 	}
 }
 
 void historyClear() {
 	history.clear();
+	journal.clear();
+	journalLast = HistoryEntry();
+	journalCache = HistoryEntry();
+	journalCacheIndex = -1;
+	if (journalFile) {
+		fclose(journalFile);
+		journalFile = NULL;
+		remove(journalPath);
+	}
+	journalEnd = 0;
 	currentIndex = -1;
 	previousTime = -INFINITY;
 }
+
+void historyGetStats(HistoryStats *stats) {
+	stats->memoryBytes = historyBytes;
+	stats->memoryStates = history.size();
+	stats->diskBytes = journalEnd;
+	stats->diskStates = journal.size();
+}
@@ -45,6 +45,11 @@ __asm__(".symver realpath,realpath@GLIBC_2.2.5");
 int main(int argc, char **argv) {
 	srand(time(NULL));
 
+	// Headless rendering, without initializing SDL
+	if (argc >= 2 && strcmp(argv[1], "--render") == 0) {
+		return renderMain(argc - 2, argv + 2);
+	}
+
 #ifdef ARCH_MAC
 	fixWorkingDirectory();
 #endif
@@ -77,9 +82,10 @@ int main(int argc, char **argv) {
 	ImGui_ImplSdlGL2_Init(window);
 
 	// Initialize modules
+	parallelInit();
 	uiInit();
 	historyClear();
-	currentBank.load("autosave.dat");
+	autosaveInit();
 	historyPush();
 	catalogInit();
 	audioInit();
@@ -124,6 +130,8 @@ int main(int argc, char **argv) {
 			// Build render buffer
 			uiRender();
 		}
+		audioUpdate();
+		autosaveUpdate();
 
 		// Render frame
 		glViewport(0, 0, (int)ImGui::GetIO().DisplaySize.x, (int)ImGui::GetIO().DisplaySize.y);
@@ -134,10 +142,14 @@ int main(int argc, char **argv) {
 		SDL_GL_SwapWindow(window);
 	}
 
-	currentBank.save("autosave.dat");
+	autosaveDestroy();
+	// Deletes the undo journal
+	historyClear();
 
 	// Cleanup
+	catalogDestroy();
 	uiDestroy();
+	parallelDestroy();
 	ImGui_ImplSdlGL2_Shutdown();
 	SDL_GL_DeleteContext(glContext);
 	SDL_DestroyWindow(window);
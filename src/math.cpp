@@ -2,21 +2,234 @@
 #include <string.h>
 #include "pffft/pffft.h"
 #include <samplerate.h>
+#ifdef __SSE2__
+#include <pmmintrin.h>
+#include "vecmath.hpp"
+#endif
 
 
+/** Transforms lengths which have no FixedFFT.
+Every length the app uses has one, so this fallback creates its setup and buffers on each call.
+*/
 static void FFT(const float *in, float *out, int len, bool inverse) {
 	PFFFT_Setup *setup = pffft_new_setup(len, PFFFT_REAL);
-	float *work = NULL;
-	if (len >= 4096)
-		work = (float*)pffft_aligned_malloc(sizeof(float) * len);
-	pffft_transform_ordered(setup, in, out, work, inverse ? PFFFT_BACKWARD : PFFFT_FORWARD);
+	assert(setup);
+	// The SIMD path of pffft requires 16-byte aligned buffers
+	float *data = (float*)pffft_aligned_malloc(sizeof(float) * len);
+	float *work = (float*)pffft_aligned_malloc(sizeof(float) * len);
+	memcpy(data, in, sizeof(float) * len);
+	pffft_transform_ordered(setup, data, data, work, inverse ? PFFFT_BACKWARD : PFFFT_FORWARD);
+	memcpy(out, data, sizeof(float) * len);
+	pffft_aligned_free(data);
+	pffft_aligned_free(work);
 	pffft_destroy_setup(setup);
-	if (work)
-		pffft_aligned_free(work);
+}
+
+
+/** Real FFT of a length known at compile time.
+Runs the half-length complex FFT as radix-4 stages (two fused radix-2 stages each) on split real/imaginary arrays, with a leading radix-2 stage when log2(N/2) is odd.
+All loop bounds are constants, and each stage's twiddles are contiguous so the butterfly loops vectorize.
+C++11 constexpr cannot evaluate cos/sin, so the tables are filled once when first used.
+*/
+template <int N>
+struct FixedFFT {
+	static const int M = N / 2;
+	static const int LOG2M = (M >= 512) ? 9 : (M >= 256) ? 8 : (M >= 128) ? 7 : (M >= 64) ? 6 : (M >= 32) ? 5 : 4;
+	static_assert(M == (1 << LOG2M), "FixedFFT length must be a power of two between 32 and 1024");
+
+	int bitrev[M];
+	/** Per radix-4 stage, W_{4s}^j and W_{4s}^{2j} for j < s, stored consecutively for increasing s */
+	ALIGNED float w1r[M];
+	ALIGNED float w1i[M];
+	ALIGNED float w2r[M];
+	ALIGNED float w2i[M];
+	/** cos and sin of 2 pi k / N */
+	float splitCos[M];
+	float splitSin[M];
+
+	FixedFFT() {
+		for (int i = 0; i < M; i++) {
+			int r = 0;
+			for (int b = 0; b < LOG2M; b++) {
+				if (i & (1 << b))
+					r |= 1 << (LOG2M - 1 - b);
+			}
+			bitrev[i] = r;
+		}
+		int offset = 0;
+		for (int s = (LOG2M % 2) ? 2 : 1; s < M; s *= 4) {
+			for (int j = 0; j < s; j++) {
+				w1r[offset + j] = cos(2 * M_PI * j / (4 * s));
+				w1i[offset + j] = -sin(2 * M_PI * j / (4 * s));
+				w2r[offset + j] = cos(2 * M_PI * 2 * j / (4 * s));
+				w2i[offset + j] = -sin(2 * M_PI * 2 * j / (4 * s));
+			}
+			offset += s;
+		}
+		for (int k = 0; k < M; k++) {
+			splitCos[k] = cos(2 * M_PI * k / N);
+			splitSin[k] = sin(2 * M_PI * k / N);
+		}
+	}
+
+	/** One radix-4 stage combining transforms of size S into size 4S, followed by the remaining stages.
+The stage size is a template parameter so the compiler can unroll every stage completely.
+*/
+	template <bool INVERSE, int S, int OFFSET>
+	struct Stage {
+		static void run(const FixedFFT &fft, float *re, float *im) {
+			const float sign = INVERSE ? -1.0 : 1.0;
+			const float *w1rs = &fft.w1r[OFFSET];
+			const float *w1is = &fft.w1i[OFFSET];
+			const float *w2rs = &fft.w2r[OFFSET];
+			const float *w2is = &fft.w2i[OFFSET];
+			for (int a = 0; a < M; a += 4 * S) {
+				float *r0 = &re[a];
+				float *i0 = &im[a];
+				float *r1 = &re[a + S];
+				float *i1 = &im[a + S];
+				float *r2 = &re[a + 2 * S];
+				float *i2 = &im[a + 2 * S];
+				float *r3 = &re[a + 3 * S];
+				float *i3 = &im[a + 3 * S];
+				for (int j = 0; j < S; j++) {
+					float c1 = w1rs[j];
+					float s1 = sign * w1is[j];
+					float c2 = w2rs[j];
+					float s2 = sign * w2is[j];
+					// First radix-2 stage, twiddle W_{2S}^j
+					float t1r = c2 * r1[j] - s2 * i1[j];
+					float t1i = c2 * i1[j] + s2 * r1[j];
+					float t3r = c2 * r3[j] - s2 * i3[j];
+					float t3i = c2 * i3[j] + s2 * r3[j];
+					float y0r = r0[j] + t1r;
+					float y0i = i0[j] + t1i;
+					float y1r = r0[j] - t1r;
+					float y1i = i0[j] - t1i;
+					float y2r = r2[j] + t3r;
+					float y2i = i2[j] + t3i;
+					float y3r = r2[j] - t3r;
+					float y3i = i2[j] - t3i;
+					// Second radix-2 stage, twiddles W_{4S}^j and W_{4S}^{j+S} = W_{4S}^j * -i
+					float u2r = c1 * y2r - s1 * y2i;
+					float u2i = c1 * y2i + s1 * y2r;
+					float u3r = c1 * y3r - s1 * y3i;
+					float u3i = c1 * y3i + s1 * y3r;
+					// Multiply u3 by -i, or +i for the inverse
+					float v3r = sign * u3i;
+					float v3i = -sign * u3r;
+					r0[j] = y0r + u2r;
+					i0[j] = y0i + u2i;
+					r2[j] = y0r - u2r;
+					i2[j] = y0i - u2i;
+					r1[j] = y1r + v3r;
+					i1[j] = y1i + v3i;
+					r3[j] = y1r - v3r;
+					i3[j] = y1i - v3i;
+				}
+			}
+			Stage<INVERSE, (4 * S < M ? 4 * S : 0), OFFSET + S>::run(fft, re, im);
+		}
+	};
+
+	template <bool INVERSE, int OFFSET>
+	struct Stage<INVERSE, 0, OFFSET> {
+		static void run(const FixedFFT &fft, float *re, float *im) {}
+	};
+
+	/** In-place complex FFT of bit-reversed input. The inverse uses conjugate twiddles and is unnormalized. */
+	template <bool INVERSE>
+	void transform(float *re, float *im) const {
+		if (LOG2M % 2) {
+			for (int a = 0; a < M; a += 2) {
+				float tr = re[a + 1];
+				float ti = im[a + 1];
+				re[a + 1] = re[a] - tr;
+				im[a + 1] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+		Stage<INVERSE, (LOG2M % 2) ? 2 : 1, 0>::run(*this, re, im);
+	}
+
+	/** Same result as RFFT(), including the 1/N normalization */
+	void forward(const float *in, float *out) const {
+		ALIGNED float re[M];
+		ALIGNED float im[M];
+		for (int n = 0; n < M; n++) {
+			re[bitrev[n]] = in[2 * n];
+			im[bitrev[n]] = in[2 * n + 1];
+		}
+		transform<false>(re, im);
+
+		const float a = 1.0 / N;
+		out[0] = (re[0] + im[0]) * a;
+		out[1] = (re[0] - im[0]) * a;
+		for (int k = 1; k < M; k++) {
+			float wr = splitCos[k];
+			float wi = -splitSin[k];
+			float er = 0.5 * (re[k] + re[M - k]);
+			float ei = 0.5 * (im[k] - im[M - k]);
+			float or_ = 0.5 * (im[k] + im[M - k]);
+			float oi = -0.5 * (re[k] - re[M - k]);
+			out[2 * k] = (er + wr * or_ - wi * oi) * a;
+			out[2 * k + 1] = (ei + wr * oi + wi * or_) * a;
+		}
+	}
+
+	/** Same result as IRFFT() */
+	void inverse(const float *in, float *out) const {
+		ALIGNED float re[M];
+		ALIGNED float im[M];
+		for (int k = 0; k < M; k++) {
+			float xr, xi, yr, yi;
+			if (k == 0) {
+				xr = in[0];
+				xi = 0.0;
+				yr = in[1];
+				yi = 0.0;
+			}
+			else {
+				xr = in[2 * k];
+				xi = in[2 * k + 1];
+				yr = in[2 * (M - k)];
+				yi = -in[2 * (M - k) + 1];
+			}
+			float wr = splitCos[k];
+			float wi = splitSin[k];
+			float dr = xr - yr;
+			float di = xi - yi;
+			re[bitrev[k]] = (xr + yr) - (dr * wi + di * wr);
+			im[bitrev[k]] = (xi + yi) + (dr * wr - di * wi);
+		}
+		transform<true>(re, im);
+		for (int n = 0; n < M; n++) {
+			out[2 * n] = re[n];
+			out[2 * n + 1] = im[n];
+		}
+	}
+};
+
+/** Returns the shared FixedFFT<N>, thread-safely constructed on first use */
+template <int N>
+static const FixedFFT<N> &getFixedFFT() {
+	static const FixedFFT<N> fft;
+	return fft;
 }
 
 
 void RFFT(const float *in, float *out, int len) {
+	// Specialized paths for the wave length and the editor's 4x oversampled preview
+	if (len == WAVE_LEN) {
+		getFixedFFT<WAVE_LEN>().forward(in, out);
+		return;
+	}
+	if (len == WAVE_LEN * 4) {
+		getFixedFFT<WAVE_LEN * 4>().forward(in, out);
+		return;
+	}
+
 	FFT(in, out, len, false);
 
 	float a = 1.0 / len;
@@ -27,10 +240,33 @@ void RFFT(const float *in, float *out, int len) {
 
 
 void IRFFT(const float *in, float *out, int len) {
+	if (len == WAVE_LEN) {
+		getFixedFFT<WAVE_LEN>().inverse(in, out);
+		return;
+	}
+	if (len == WAVE_LEN * 4) {
+		getFixedFFT<WAVE_LEN * 4>().inverse(in, out);
+		return;
+	}
+
 	FFT(in, out, len, true);
 }
 
 
+void RFFTBatch(const float *const *in, float *const *out, int len, int count) {
+	for (int i = 0; i < count; i++) {
+		RFFT(in[i], out[i], len);
+	}
+}
+
+
+void IRFFTBatch(const float *const *in, float *const *out, int len, int count) {
+	for (int i = 0; i < count; i++) {
+		IRFFT(in[i], out[i], len);
+	}
+}
+
+
 int resample(const float *in, int inLen, float *out, int outLen, double ratio) {
 	SRC_DATA data;
 	// Old versions of libsamplerate don't use const here
@@ -45,28 +281,186 @@ int resample(const float *in, int inLen, float *out, int outLen, double ratio) {
 }
 
 
+void *alignedMalloc(size_t size) {
+	// pffft aligns its allocations for its own SIMD loads, which is at least SIMD_ALIGN
+	void *ptr = pffft_aligned_malloc(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+
+void alignedFree(void *ptr) {
+	pffft_aligned_free(ptr);
+}
+
+
 void cyclicOversample(const float *in, float *out, int len, int oversample) {
-	float x[len * oversample];
-	memset(x, 0, sizeof(x));
+	int outLen = len * oversample;
+	float *x = (float*)pffft_aligned_malloc(sizeof(float) * outLen);
+	memset(x, 0, sizeof(float) * outLen);
 	// Zero-stuff oversampled buffer
 	for (int i = 0; i < len; i++) {
 		x[i * oversample] = in[i] * oversample;
 	}
-	float fft[len * oversample];
-	RFFT(x, fft, len * oversample);
+	float *fft = (float*)pffft_aligned_malloc(sizeof(float) * outLen);
+	RFFT(x, fft, outLen);
 
 	// Apply brick wall filter
 	// y_{N/2} = 0
 	fft[1] = 0.0;
 	// y_k = 0 for k >= len
-	for (int i = len / 2; i < len * oversample / 2; i++) {
+	for (int i = len / 2; i < outLen / 2; i++) {
 		fft[2*i] = 0.0;
 		fft[2*i + 1] = 0.0;
 	}
 
-	IRFFT(fft, out, len * oversample);
+	IRFFT(fft, out, outLen);
+	pffft_aligned_free(x);
+	pffft_aligned_free(fft);
+}
+
+
+#ifdef __SSE2__
+
+struct SSE2Ops {
+	typedef __m128 V;
+	typedef __m128i I;
+	static const int WIDTH = 4;
+
+	static inline V set1(float x) {return _mm_set1_ps(x);}
+	static inline V load(const float *p) {return _mm_loadu_ps(p);}
+	static inline void store(float *p, V x) {_mm_storeu_ps(p, x);}
+	static inline V add(V a, V b) {return _mm_add_ps(a, b);}
+	static inline V sub(V a, V b) {return _mm_sub_ps(a, b);}
+	static inline V mul(V a, V b) {return _mm_mul_ps(a, b);}
+	static inline V sqrt(V a) {return _mm_sqrt_ps(a);}
+	static inline V bitAnd(V a, V b) {return _mm_and_ps(a, b);}
+	static inline V bitOr(V a, V b) {return _mm_or_ps(a, b);}
+	static inline V bitXor(V a, V b) {return _mm_xor_ps(a, b);}
+	static inline V bitAndNot(V a, V b) {return _mm_andnot_ps(a, b);}
+	static inline V greater(V a, V b) {return _mm_cmpgt_ps(a, b);}
+	static inline V equal(V a, V b) {return _mm_cmpeq_ps(a, b);}
+	static inline V select(V mask, V a, V b) {return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));}
+	static inline I roundToInt(V a) {return _mm_cvtps_epi32(a);}
+	static inline V toFloat(I a) {return _mm_cvtepi32_ps(a);}
+	static inline V oddSignMask(I k) {return _mm_castsi128_ps(_mm_slli_epi32(k, 31));}
+	static inline V pairSum(V a, V b) {
+#ifdef __SSE3__
+		return _mm_hadd_ps(a, b);
+#else
+		V even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		V odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		return _mm_add_ps(even, odd);
+#endif
+	}
+};
+
+/** Whether the AVX2 kernels in math_avx2.cpp can run on this CPU */
+static bool cpuHasAVX2() {
+#if defined ARCH_WIN
+	// MinGW does not align the stack for 32-byte AVX spills
+	return false;
+#elif defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif
 }
 
+bool useAVX2() {
+	static const bool avx2 = cpuHasAVX2();
+	return avx2;
+}
+
+void sinv(const float *x, float *out, int len) {
+	if (useAVX2())
+		sinvAVX2(x, out, len);
+	else
+		vecSinArray<SSE2Ops>(x, out, len);
+}
+
+void sin2piv(const float *x, float *out, int len) {
+	if (useAVX2())
+		sin2pivAVX2(x, out, len);
+	else
+		vecSin2piArray<SSE2Ops>(x, out, len);
+}
+
+void sincos2piv(const float *x, float *outSin, float *outCos, int len) {
+	if (useAVX2())
+		sincos2pivAVX2(x, outSin, outCos, len);
+	else
+		vecSinCos2piArray<SSE2Ops>(x, outSin, outCos, len);
+}
+
+void asinv(const float *x, float *out, int len) {
+	if (useAVX2())
+		asinvAVX2(x, out, len);
+	else
+		vecAsinArray<SSE2Ops>(x, out, len);
+}
+
+void roundv(const float *x, float *out, int len) {
+	if (useAVX2())
+		roundvAVX2(x, out, len);
+	else
+		vecRoundArray<SSE2Ops>(x, out, len);
+}
+
+void cabsv(const float *z, float *out, int len) {
+	if (useAVX2())
+		cabsvAVX2(z, out, len);
+	else
+		vecCabsArray<SSE2Ops>(z, out, len);
+}
+
+#else
+
+bool useAVX2() {
+	return false;
+}
+
+void sinv(const float *x, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = sinf(x[i]);
+	}
+}
+
+void sin2piv(const float *x, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = sinf(2 * M_PI * x[i]);
+	}
+}
+
+void sincos2piv(const float *x, float *outSin, float *outCos, int len) {
+	for (int i = 0; i < len; i++) {
+		outSin[i] = sinf(2 * M_PI * x[i]);
+		outCos[i] = cosf(2 * M_PI * x[i]);
+	}
+}
+
+void asinv(const float *x, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = asinf(x[i]);
+	}
+}
+
+void roundv(const float *x, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = roundf(x[i]);
+	}
+}
+
+void cabsv(const float *z, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = hypotf(z[2 * i], z[2 * i + 1]);
+	}
+}
+
+#endif
+
 
 void i16_to_f32(const int16_t *in, float *out, int length) {
 	for (int i = 0; i < length; i++) {
@@ -0,0 +1,65 @@
+// AVX2 instantiations of the kernels in vecmath.hpp.
+// This file is compiled with -mavx2 -mfma, so it must not include WaveEdit.hpp or any header with inline functions.
+// Otherwise the linker could keep the AVX2 copy of an inline function and call it on CPUs without AVX2.
+#ifdef __AVX2__
+
+#include <immintrin.h>
+#include "vecmath.hpp"
+
+
+struct AVX2Ops {
+	typedef __m256 V;
+	typedef __m256i I;
+	static const int WIDTH = 8;
+
+	static inline V set1(float x) {return _mm256_set1_ps(x);}
+	static inline V load(const float *p) {return _mm256_loadu_ps(p);}
+	static inline void store(float *p, V x) {_mm256_storeu_ps(p, x);}
+	static inline V add(V a, V b) {return _mm256_add_ps(a, b);}
+	static inline V sub(V a, V b) {return _mm256_sub_ps(a, b);}
+	static inline V mul(V a, V b) {return _mm256_mul_ps(a, b);}
+	static inline V sqrt(V a) {return _mm256_sqrt_ps(a);}
+	static inline V bitAnd(V a, V b) {return _mm256_and_ps(a, b);}
+	static inline V bitOr(V a, V b) {return _mm256_or_ps(a, b);}
+	static inline V bitXor(V a, V b) {return _mm256_xor_ps(a, b);}
+	static inline V bitAndNot(V a, V b) {return _mm256_andnot_ps(a, b);}
+	static inline V greater(V a, V b) {return _mm256_cmp_ps(a, b, _CMP_GT_OQ);}
+	static inline V equal(V a, V b) {return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);}
+	static inline V select(V mask, V a, V b) {return _mm256_blendv_ps(b, a, mask);}
+	static inline I roundToInt(V a) {return _mm256_cvtps_epi32(a);}
+	static inline V toFloat(I a) {return _mm256_cvtepi32_ps(a);}
+	static inline V oddSignMask(I k) {return _mm256_castsi256_ps(_mm256_slli_epi32(k, 31));}
+	/** Sums adjacent pairs of a and then b, in order */
+	static inline V pairSum(V a, V b) {
+		// hadd works within 128-bit halves, so reorder its 64-bit quarters from (a, b, a, b) to (a, a, b, b)
+		V s = _mm256_hadd_ps(a, b);
+		return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(s), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+};
+
+
+void sinvAVX2(const float *x, float *out, int len) {
+	vecSinArray<AVX2Ops>(x, out, len);
+}
+
+void sin2pivAVX2(const float *x, float *out, int len) {
+	vecSin2piArray<AVX2Ops>(x, out, len);
+}
+
+void sincos2pivAVX2(const float *x, float *outSin, float *outCos, int len) {
+	vecSinCos2piArray<AVX2Ops>(x, outSin, outCos, len);
+}
+
+void asinvAVX2(const float *x, float *out, int len) {
+	vecAsinArray<AVX2Ops>(x, out, len);
+}
+
+void roundvAVX2(const float *x, float *out, int len) {
+	vecRoundArray<AVX2Ops>(x, out, len);
+}
+
+void cabsvAVX2(const float *z, float *out, int len) {
+	vecCabsArray<AVX2Ops>(z, out, len);
+}
+
+#endif
@@ -0,0 +1,250 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <float.h>
+
+
+#ifdef __SSE2__
+// Defined in oscillator_avx2.cpp
+void voiceGroupAVX2(const float *base, const int *offsets, int corners, int waveLen, const float *levelFrac, const float *gain, float *phase, const float *delta, const float *frequency, const float *morph, const float *morphOffset, const float *morphIndex, float morphMin, float morphMax, const float *morphY, float morphYIndex, float *out, int len);
+#endif
+
+
+void WaveTable::build(const float *samples) {
+	ALIGNED float spectrum[WAVE_LEN];
+	RFFT(samples, spectrum, WAVE_LEN);
+
+	// Truncate the spectrum once for each level, then invert every level at once
+	ALIGNED float truncated[MIP_LEVELS][WAVE_LEN];
+	ALIGNED float out[MIP_LEVELS][WAVE_LEN];
+	const float *in[MIP_LEVELS];
+	float *outs[MIP_LEVELS];
+	for (int l = 0; l < MIP_LEVELS; l++) {
+		int harmonics = (WAVE_LEN / 2) >> l;
+		memcpy(truncated[l], spectrum, sizeof(float) * WAVE_LEN);
+		// Nyquist
+		truncated[l][1] = 0.f;
+		for (int k = harmonics; k < WAVE_LEN / 2; k++) {
+			truncated[l][2 * k] = 0.f;
+			truncated[l][2 * k + 1] = 0.f;
+		}
+		in[l] = truncated[l];
+		outs[l] = out[l];
+	}
+	IRFFTBatch(in, outs, WAVE_LEN, MIP_LEVELS);
+
+	for (int l = 0; l < MIP_LEVELS; l++) {
+		memcpy(levels[l], out[l], sizeof(float) * WAVE_LEN);
+		levels[l][WAVE_LEN] = levels[l][0];
+	}
+}
+
+
+void mipSelect(float frequency, float sampleRate, int *level, float *levelFrac) {
+	// Level l contains harmonics up to (WAVE_LEN / 2 >> l) - 1, which must stay below the Nyquist frequency.
+	// So continuously, l = log2(WAVE_LEN * frequency / sampleRate), and level ceil(l) is the richest level without aliasing.
+	float l = log2f(WAVE_LEN * frequency / sampleRate);
+	if (l >= MIP_LEVELS - 1) {
+		// Even the fundamental is above the Nyquist frequency
+		*level = MIP_LEVELS - 1;
+		*levelFrac = 0.f;
+		return;
+	}
+	if (!(l > -1.f)) {
+		*level = 0;
+		*levelFrac = 0.f;
+		return;
+	}
+	int li = (int) ceilf(l);
+	if (li >= MIP_LEVELS - 2) {
+		// The second to last level holds only the fundamental, so never fade it into the last level, which holds only DC
+		*level = MIP_LEVELS - 2;
+		*levelFrac = 0.f;
+		return;
+	}
+	// Crossfade from level ceil(l) into ceil(l) + 1, reaching it as l reaches the next whole level, which avoids a timbre jump at each octave.
+	// Both levels are alias-free, at the cost of fading out the top octave of harmonics which would still fit.
+	*level = li;
+	*levelFrac = l - li + 1.f;
+}
+
+
+VoicePool::VoicePool() {
+	for (int v = 0; v < VOICES_MAX; v++) {
+		// Spread the starting phases by the golden ratio so unison voices don't add up coherently
+		phase[v] = fmodf(v * 0.618034f, 1.f);
+		ratio[v] = 1.f;
+		morphOffset[v] = 0.f;
+	}
+}
+
+
+void VoicePool::process(const WaveTable *tables, const float *frequency, const float *morphX, const float *morphY, const float *morphZ, float sampleRate, float *out, int len) {
+	memset(out, 0, sizeof(float) * len);
+	float maxFrequency = 0.f;
+	for (int i = 0; i < len; i++) {
+		maxFrequency = fmaxf(maxFrequency, frequency[i]);
+	}
+	float gain = 1.f / sqrtf(count);
+	bool xy = morphX && morphY;
+	int corners = xy ? 4 : 2;
+
+	for (int g = 0; g < count; g += VOICE_GROUP) {
+		// Lanes past the last voice are silenced
+		ALIGNED float laneGain[VOICE_GROUP];
+		ALIGNED float lanePhase[VOICE_GROUP];
+		ALIGNED float laneDelta[VOICE_GROUP];
+		ALIGNED float laneOffset[VOICE_GROUP];
+		int level[VOICE_GROUP];
+		ALIGNED float levelFrac[VOICE_GROUP];
+		for (int v = 0; v < VOICE_GROUP; v++) {
+			laneGain[v] = (g + v < count) ? gain : 0.f;
+			lanePhase[v] = phase[g + v];
+			laneDelta[v] = ratio[g + v] / sampleRate;
+			laneOffset[v] = morphOffset[g + v];
+			// Use the band limit of the highest frequency in this block
+			mipSelect(maxFrequency * ratio[g + v], sampleRate, &level[v], &levelFrac[v]);
+		}
+
+		// Only gather for voices which exist. The rest of the lanes stay silent
+		int lanes = mini(VOICE_GROUP, count - g);
+		ALIGNED float corner[4][VOICE_GROUP] = {};
+
+		// Split the block into segments in which no lane crosses into another wave, so the neighbor waves are looked up once per segment
+		int i = 0;
+		while (i < len) {
+			// Levels of each morph corner, indexed by [corner][upper level][lane]
+			const float *levels[4][2][VOICE_GROUP];
+			int waveIndex[VOICE_GROUP][4];
+			// The segment lasts while the played morph position stays within [lo, hi) on each axis
+			// FLT_MAX instead of infinity, which -ffast-math assumes never occurs
+			float lo[2] = {-FLT_MAX, -FLT_MAX};
+			float hi[2] = {FLT_MAX, FLT_MAX};
+			int xi = 0, yi = 0;
+			int zi[VOICE_GROUP];
+			if (xy) {
+				xi = clampi(morphX[i], 0, BANK_GRID_WIDTH - 1);
+				yi = clampi(morphY[i], 0, BANK_GRID_HEIGHT - 1);
+				int x1 = eucmodi(xi + 1, BANK_GRID_WIDTH);
+				int y1 = eucmodi(yi + 1, BANK_GRID_HEIGHT);
+				if (xi > 0) lo[0] = xi;
+				if (xi < BANK_GRID_WIDTH - 1) hi[0] = xi + 1;
+				if (yi > 0) lo[1] = yi;
+				if (yi < BANK_GRID_HEIGHT - 1) hi[1] = yi + 1;
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					waveIndex[v][0] = yi * BANK_GRID_WIDTH + xi;
+					waveIndex[v][1] = yi * BANK_GRID_WIDTH + x1;
+					waveIndex[v][2] = y1 * BANK_GRID_WIDTH + xi;
+					waveIndex[v][3] = y1 * BANK_GRID_WIDTH + x1;
+				}
+			}
+			else {
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					float z = clampf(morphZ[i] + laneOffset[v], 0.f, BANK_LEN - 1);
+					zi[v] = z;
+					if (zi[v] > 0) lo[0] = fmaxf(lo[0], zi[v] - laneOffset[v]);
+					if (zi[v] < BANK_LEN - 1) hi[0] = fminf(hi[0], zi[v] + 1 - laneOffset[v]);
+					waveIndex[v][0] = zi[v];
+					waveIndex[v][1] = eucmodi(zi[v] + 1, BANK_LEN);
+				}
+			}
+			for (int c = 0; c < corners; c++) {
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					const WaveTable *table = &tables[waveIndex[v][c]];
+					levels[c][0][v] = table->levels[level[v]];
+					levels[c][1][v] = table->levels[mini(level[v] + 1, MIP_LEVELS - 1)];
+				}
+			}
+
+			int end = i + 1;
+			if (xy) {
+				while (end < len && lo[0] <= morphX[end] && morphX[end] < hi[0] && lo[1] <= morphY[end] && morphY[end] < hi[1])
+					end++;
+			}
+			else {
+				while (end < len && lo[0] <= morphZ[end] && morphZ[end] < hi[0])
+					end++;
+			}
+
+#ifdef __SSE2__
+			if (useAVX2()) {
+				// Gather from all lanes, which is safe because the levels of missing voices still point into `tables`, and their gain is 0
+				int offsets[4][2][VOICE_GROUP];
+				for (int c = 0; c < corners; c++) {
+					for (int l = 0; l < 2; l++) {
+						for (int v = 0; v < VOICE_GROUP; v++) {
+							offsets[c][l][v] = levels[c][l][v] - (const float*) tables;
+						}
+					}
+				}
+				ALIGNED float zero[VOICE_GROUP] = {};
+				ALIGNED float morphIndex[VOICE_GROUP];
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					morphIndex[v] = xy ? xi : zi[v];
+				}
+				if (xy)
+					voiceGroupAVX2((const float*) tables, &offsets[0][0][0], corners, WAVE_LEN, levelFrac, laneGain, lanePhase, laneDelta, &frequency[i], &morphX[i], zero, morphIndex, -FLT_MAX, FLT_MAX, &morphY[i], yi, &out[i], end - i);
+				else
+					voiceGroupAVX2((const float*) tables, &offsets[0][0][0], corners, WAVE_LEN, levelFrac, laneGain, lanePhase, laneDelta, &frequency[i], &morphZ[i], laneOffset, morphIndex, 0.f, BANK_LEN - 1, NULL, 0.f, &out[i], end - i);
+				i = end;
+				continue;
+			}
+#endif
+			for (; i < end; i++) {
+				// Wave positions and morph weights of each lane
+				int index[VOICE_GROUP];
+				ALIGNED float frac[VOICE_GROUP];
+				ALIGNED float morphFrac[VOICE_GROUP];
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					float pos = lanePhase[v] * WAVE_LEN;
+					index[v] = mini((int) pos, WAVE_LEN - 1);
+					frac[v] = pos - index[v];
+				}
+				if (xy) {
+					for (int v = 0; v < VOICE_GROUP; v++) {
+						morphFrac[v] = morphX[i] - xi;
+					}
+				}
+				else {
+					for (int v = 0; v < VOICE_GROUP; v++) {
+						morphFrac[v] = clampf(morphZ[i] + laneOffset[v], 0.f, BANK_LEN - 1) - zi[v];
+					}
+				}
+
+				// Gather the two neighboring samples from each morph corner and mip level
+				for (int c = 0; c < corners; c++) {
+					for (int v = 0; v < lanes; v++) {
+						const float *a = levels[c][0][v] + index[v];
+						const float *b = levels[c][1][v] + index[v];
+						float va = a[0] + (a[1] - a[0]) * frac[v];
+						float vb = b[0] + (b[1] - b[0]) * frac[v];
+						corner[c][v] = va + (vb - va) * levelFrac[v];
+					}
+				}
+
+				// Crossfade the corners, mix, and advance
+				ALIGNED float y[VOICE_GROUP];
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					y[v] = crossf(corner[0][v], corner[1][v], morphFrac[v]);
+				}
+				if (xy) {
+					float yf = morphY[i] - yi;
+					for (int v = 0; v < VOICE_GROUP; v++) {
+						float y1 = crossf(corner[2][v], corner[3][v], morphFrac[v]);
+						y[v] = crossf(y[v], y1, yf);
+					}
+				}
+				float sum = 0.f;
+				for (int v = 0; v < VOICE_GROUP; v++) {
+					sum += y[v] * laneGain[v];
+					lanePhase[v] += frequency[i] * laneDelta[v];
+					lanePhase[v] -= floorf(lanePhase[v]);
+				}
+				out[i] += sum;
+			}
+		}
+
+		for (int v = 0; v < VOICE_GROUP; v++) {
+			phase[g + v] = lanePhase[v];
+		}
+	}
+}
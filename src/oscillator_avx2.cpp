@@ -0,0 +1,76 @@
+// AVX2 kernel of VoicePool::process(), which gathers the samples of all 8 voices of a group at once.
+// Like math_avx2.cpp, this file is compiled with -mavx2 -mfma, so it must not include WaveEdit.hpp or any header with inline functions.
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+
+/** Returns a + (b - a) * t */
+static inline __m256 lerp(__m256 a, __m256 b, __m256 t) {
+	return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+/** Returns (1 - t) * a + t * b, like crossf() */
+static inline __m256 cross(__m256 a, __m256 b, __m256 t) {
+	return _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), t), a), _mm256_mul_ps(t, b));
+}
+
+/** Renders `len` samples of a group of 8 voices, during which no voice moves to another wave, and adds their sum to `out`.
+The arguments are the per-lane state of VoicePool::process().
+`offsets` gives the position of the two mip levels of each morph corner relative to `base`, indexed by [corner][upper level][lane].
+The morph fraction along the first axis is clamp(morph + morphOffset, morphMin, morphMax) - morphIndex, and along the second axis, if `morphY` is non-NULL, morphY - morphYIndex.
+*/
+void voiceGroupAVX2(const float *base, const int *offsets, int corners, int waveLen, const float *levelFrac, const float *gain, float *phase, const float *delta, const float *frequency, const float *morph, const float *morphOffset, const float *morphIndex, float morphMin, float morphMax, const float *morphY, float morphYIndex, float *out, int len) {
+	__m256i offset[4][2];
+	for (int c = 0; c < corners; c++) {
+		offset[c][0] = _mm256_loadu_si256((const __m256i*) &offsets[(2 * c + 0) * 8]);
+		offset[c][1] = _mm256_loadu_si256((const __m256i*) &offsets[(2 * c + 1) * 8]);
+	}
+	__m256 vLevelFrac = _mm256_loadu_ps(levelFrac);
+	__m256 vGain = _mm256_loadu_ps(gain);
+	__m256 vPhase = _mm256_loadu_ps(phase);
+	__m256 vDelta = _mm256_loadu_ps(delta);
+	__m256 vMorphOffset = _mm256_loadu_ps(morphOffset);
+	__m256 vMorphIndex = _mm256_loadu_ps(morphIndex);
+	__m256 vWaveLen = _mm256_set1_ps(waveLen);
+	__m256i vLastIndex = _mm256_set1_epi32(waveLen - 1);
+
+	for (int i = 0; i < len; i++) {
+		__m256 pos = _mm256_mul_ps(vPhase, vWaveLen);
+		__m256i index = _mm256_min_epi32(_mm256_cvttps_epi32(pos), vLastIndex);
+		__m256 frac = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(index));
+		__m256 morphFrac = _mm256_add_ps(_mm256_set1_ps(morph[i]), vMorphOffset);
+		morphFrac = _mm256_min_ps(_mm256_max_ps(morphFrac, _mm256_set1_ps(morphMin)), _mm256_set1_ps(morphMax));
+		morphFrac = _mm256_sub_ps(morphFrac, vMorphIndex);
+
+		// Gather the two neighboring samples from each morph corner and mip level
+		__m256 corner[4];
+		for (int c = 0; c < corners; c++) {
+			__m256i ia = _mm256_add_epi32(offset[c][0], index);
+			__m256i ib = _mm256_add_epi32(offset[c][1], index);
+			__m256 a0 = _mm256_i32gather_ps(base, ia, 4);
+			__m256 a1 = _mm256_i32gather_ps(base + 1, ia, 4);
+			__m256 b0 = _mm256_i32gather_ps(base, ib, 4);
+			__m256 b1 = _mm256_i32gather_ps(base + 1, ib, 4);
+			corner[c] = lerp(lerp(a0, a1, frac), lerp(b0, b1, frac), vLevelFrac);
+		}
+
+		// Crossfade the corners, mix, and advance
+		__m256 y = cross(corner[0], corner[1], morphFrac);
+		if (morphY) {
+			__m256 y1 = cross(corner[2], corner[3], morphFrac);
+			y = cross(y, y1, _mm256_set1_ps(morphY[i] - morphYIndex));
+		}
+		y = _mm256_mul_ps(y, vGain);
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(y), _mm256_extractf128_ps(y, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		out[i] += _mm_cvtss_f32(s);
+
+		vPhase = _mm256_add_ps(vPhase, _mm256_mul_ps(_mm256_set1_ps(frequency[i]), vDelta));
+		vPhase = _mm256_sub_ps(vPhase, _mm256_floor_ps(vPhase));
+	}
+	_mm256_storeu_ps(phase, vPhase);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "WaveEdit.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+static std::vector<std::thread> workers;
+/** Held for the duration of a parallelFor() call, so jobs from different threads run one at a time */
+static std::mutex jobMutex;
+/** Guards everything below */
+static std::mutex stateMutex;
+static std::condition_variable startCondition;
+static std::condition_variable doneCondition;
+static bool running = false;
+static int jobGeneration = 0;
+static int jobWorkers = 0;
+static const std::function<void(int)> *jobFunction = NULL;
+static int jobLen = 0;
+static std::atomic<int> jobNext(0);
+static thread_local bool isWorker = false;
+
+
+/** Claims indices of the current job until none are left */
+static void runJob() {
+	while (true) {
+		int i = jobNext++;
+		if (i >= jobLen)
+			break;
+		(*jobFunction)(i);
+	}
+}
+
+static void workerRun() {
+	isWorker = true;
+	int generation = 0;
+	std::unique_lock<std::mutex> lock(stateMutex);
+	while (true) {
+		startCondition.wait(lock, [&]{ return !running || jobGeneration != generation; });
+		if (!running)
+			break;
+		generation = jobGeneration;
+		lock.unlock();
+		runJob();
+		lock.lock();
+		jobWorkers--;
+		if (jobWorkers == 0)
+			doneCondition.notify_one();
+	}
+}
+
+
+void parallelInit() {
+	assert(workers.empty());
+	// The calling thread also works on each job, so leave one core for it
+	int threads = (int) std::thread::hardware_concurrency() - 1;
+	running = true;
+	for (int i = 0; i < threads; i++) {
+		workers.push_back(std::thread(workerRun));
+	}
+}
+
+
+void parallelDestroy() {
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		running = false;
+	}
+	startCondition.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+
+void parallelFor(int len, const std::function<void(int)> &f) {
+	// Run serially if there are no workers, or if called from within a job, which would otherwise deadlock
+	if (workers.empty() || isWorker || len <= 1) {
+		for (int i = 0; i < len; i++) {
+			f(i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> jobLock(jobMutex);
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		jobFunction = &f;
+		jobLen = len;
+		jobNext = 0;
+		jobWorkers = workers.size();
+		jobGeneration++;
+	}
+	startCondition.notify_all();
+	runJob();
+
+	// Wait for the workers to finish the indices they have claimed
+	std::unique_lock<std::mutex> lock(stateMutex);
+	doneCondition.wait(lock, [&]{ return jobWorkers == 0; });
+	jobFunction = NULL;
+}
@@ -0,0 +1,198 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <sndfile.h>
+#include <chrono>
+
+
+float RenderCurve::value(float t) const {
+	if (points.empty())
+		return 0.0;
+	if (points.size() == 1)
+		return points[0];
+	float index = clampf(t, 0.0, 1.0) * (points.size() - 1);
+	int i = mini((int) index, points.size() - 2);
+	return crossf(points[i], points[i + 1], index - i);
+}
+
+
+bool RenderCurve::parse(const char *str) {
+	points.clear();
+	const char *p = str;
+	while (true) {
+		char *end;
+		float x = strtof(p, &end);
+		if (end == p)
+			return false;
+		points.push_back(x);
+		if (*end == '\0')
+			return true;
+		if (*end != ',')
+			return false;
+		p = end + 1;
+	}
+}
+
+
+/** Samples rendered per call to VoicePool::process() */
+#define RENDER_BLOCK 256
+
+// Static because `new` does not respect their alignment before C++17
+static WaveTable renderTables[BANK_LEN];
+static Bank renderBankBuffer;
+static TimingRing renderTiming;
+
+bool renderBank(const Bank *bank, const RenderSettings &settings, const char *filename) {
+	SF_INFO info;
+	memset(&info, 0, sizeof(info));
+	info.samplerate = settings.sampleRate;
+	info.channels = 1;
+	info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16 | SF_ENDIAN_LITTLE;
+	SNDFILE *sf = sf_open(filename, SFM_WRITE, &info);
+	if (!sf)
+		return false;
+
+	WaveTable *tables = renderTables;
+	for (int i = 0; i < BANK_LEN; i++) {
+		tables[i].build(bank->waves[i].postSamples);
+	}
+
+	// Interpolate frequency in log space, so a sweep between two points moves at a constant rate in octaves
+	RenderCurve logFrequency;
+	for (float f : settings.frequency.points) {
+		logFrequency.points.push_back(log2f(clampf(f, 1.0, settings.sampleRate / 2.0)));
+	}
+	if (logFrequency.points.empty())
+		logFrequency.points.push_back(log2f(220.0));
+	bool xy = !settings.morphX.points.empty() || !settings.morphY.points.empty();
+	float gain = powf(10.0, settings.volume / 20.0);
+
+	VoicePool voices;
+	renderTiming.clear();
+	int len = settings.duration * settings.sampleRate;
+	for (int j = 0; j < len; j += RENDER_BLOCK) {
+		int blockLen = mini(RENDER_BLOCK, len - j);
+		float frequency[RENDER_BLOCK];
+		float morphX[RENDER_BLOCK];
+		float morphY[RENDER_BLOCK];
+		float morphZ[RENDER_BLOCK];
+		for (int i = 0; i < blockLen; i++) {
+			float t = (float) (j + i) / len;
+			frequency[i] = exp2f(logFrequency.value(t));
+			morphX[i] = clampf(settings.morphX.value(t), 0.0, BANK_GRID_WIDTH - 1);
+			morphY[i] = clampf(settings.morphY.value(t), 0.0, BANK_GRID_HEIGHT - 1);
+			morphZ[i] = clampf(settings.morphZ.value(t), 0.0, BANK_LEN - 1);
+		}
+
+		float out[RENDER_BLOCK];
+		auto start = std::chrono::steady_clock::now();
+		if (xy)
+			voices.process(tables, frequency, morphX, morphY, morphZ, settings.sampleRate, out, blockLen);
+		else
+			voices.process(tables, frequency, NULL, NULL, morphZ, settings.sampleRate, out, blockLen);
+		std::chrono::duration<float> duration = std::chrono::steady_clock::now() - start;
+		renderTiming.push(duration.count(), (float) blockLen / settings.sampleRate);
+		for (int i = 0; i < blockLen; i++) {
+			out[i] = clampf(out[i] * gain, -1.0, 1.0);
+		}
+		if (sf_write_float(sf, out, blockLen) != blockLen) {
+			sf_close(sf);
+			return false;
+		}
+	}
+
+	if (sf_close(sf) != 0)
+		return false;
+
+	if (!settings.statsPath.empty()) {
+		if (!timingSaveJSON(&renderTiming, "render", settings.sampleRate, RENDER_BLOCK, settings.statsPath.c_str()))
+			fprintf(stderr, "Could not write %s\n", settings.statsPath.c_str());
+	}
+	return true;
+}
+
+
+static void renderUsage() {
+	fprintf(stderr,
+		"Usage: WaveEdit --render <bank.wav or bank.dat> <output.wav> [options]\n"
+		"\n"
+		"Curves are comma-separated values, evenly spaced across the render and linearly interpolated.\n"
+		"\n"
+		"  --duration <seconds>   Length of the render (default 4)\n"
+		"  --rate <Hz>            Sample rate (default 44100)\n"
+		"  --volume <dB>          Output gain (default 0)\n"
+		"  --frequency <curve>    Frequency in Hz, interpolated exponentially (default 220)\n"
+		"  --morph-z <curve>      Morph position from 0 to %d (default 0,%d)\n"
+		"  --morph-x <curve>      Morph across the grid instead, from 0 to %d\n"
+		"  --morph-y <curve>      from 0 to %d\n"
+		"  --stats <file.json>    Write the processing time of each block as JSON\n",
+		BANK_LEN - 1, BANK_LEN - 1, BANK_GRID_WIDTH - 1, BANK_GRID_HEIGHT - 1);
+}
+
+int renderMain(int argc, char **argv) {
+	if (argc < 2) {
+		renderUsage();
+		return 1;
+	}
+	const char *bankPath = argv[0];
+	const char *outPath = argv[1];
+
+	RenderSettings settings;
+	settings.morphZ.points.push_back(0.0);
+	settings.morphZ.points.push_back(BANK_LEN - 1);
+	for (int i = 2; i < argc; i += 2) {
+		const char *option = argv[i];
+		if (i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", option);
+			return 1;
+		}
+		const char *value = argv[i + 1];
+		bool ok = true;
+		if (strcmp(option, "--duration") == 0) {
+			settings.duration = atof(value);
+			ok = settings.duration > 0.0;
+		}
+		else if (strcmp(option, "--rate") == 0) {
+			settings.sampleRate = atoi(value);
+			ok = settings.sampleRate > 0;
+		}
+		else if (strcmp(option, "--volume") == 0)
+			settings.volume = atof(value);
+		else if (strcmp(option, "--frequency") == 0)
+			ok = settings.frequency.parse(value);
+		else if (strcmp(option, "--morph-x") == 0)
+			ok = settings.morphX.parse(value);
+		else if (strcmp(option, "--morph-y") == 0)
+			ok = settings.morphY.parse(value);
+		else if (strcmp(option, "--morph-z") == 0)
+			ok = settings.morphZ.parse(value);
+		else if (strcmp(option, "--stats") == 0)
+			settings.statsPath = value;
+		else
+			ok = false;
+
+		if (!ok) {
+			fprintf(stderr, "Invalid option %s\n", option);
+			renderUsage();
+			return 1;
+		}
+	}
+
+	Bank *bank = &renderBankBuffer;
+	const char *ext = strrchr(bankPath, '.');
+	bool loaded;
+	if (ext && strcmp(ext, ".dat") == 0)
+		loaded = bank->load(bankPath);
+	else
+		loaded = bank->loadWAV(bankPath);
+	if (!loaded) {
+		fprintf(stderr, "Could not read %s\n", bankPath);
+		return 1;
+	}
+
+	bool success = renderBank(bank, settings, outPath);
+	if (!success) {
+		fprintf(stderr, "Could not write %s\n", outPath);
+		return 1;
+	}
+	return 0;
+}
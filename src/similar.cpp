@@ -0,0 +1,246 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+
+
+/** Harmonics describing the spectral shape of a wave, starting at the fundamental */
+#define FEATURE_HARMONICS 64
+
+/** Catalog waves projected onto the principal components of their harmonic spectra */
+struct SimilarIndex {
+	/** Keeps the files referenced below alive */
+	std::shared_ptr<const Catalog> catalog;
+	std::vector<const CatalogFile*> files;
+	/** Category path of each file, e.g. "Digital/Bells" */
+	std::vector<std::string> categoryNames;
+	float mean[FEATURE_HARMONICS];
+	float components[SIMILAR_DIMS][FEATURE_HARMONICS];
+	/** SIMILAR_DIMS coordinates per file, back to back */
+	std::vector<float> points;
+};
+
+/** The published index, replaced as a whole with std::atomic_store() */
+static std::shared_ptr<const SimilarIndex> similarIndex;
+
+
+/** Computes the features of `count` waves: the square roots of their harmonic magnitudes, normalized to unit length so that loudness doesn't matter */
+static void computeFeatures(const float *const *samples, int count, float *features) {
+	for (int i = 0; i < count; i += BANK_LEN) {
+		int len = mini(BANK_LEN, count - i);
+		static thread_local std::vector<float> spectra;
+		spectra.resize(BANK_LEN * WAVE_LEN);
+		float *spectrum[BANK_LEN];
+		for (int j = 0; j < len; j++) {
+			spectrum[j] = &spectra[j * WAVE_LEN];
+		}
+		RFFTBatch(&samples[i], spectrum, WAVE_LEN, len);
+
+		for (int j = 0; j < len; j++) {
+			float *feature = &features[(i + j) * FEATURE_HARMONICS];
+			// Skip the DC and Nyquist terms packed into the first complex number
+			cabsv(&spectrum[j][2], feature, FEATURE_HARMONICS);
+			float norm = 0.0;
+			for (int k = 0; k < FEATURE_HARMONICS; k++) {
+				feature[k] = sqrtf(feature[k]);
+				norm += feature[k] * feature[k];
+			}
+			norm = sqrtf(norm);
+			for (int k = 0; k < FEATURE_HARMONICS; k++) {
+				feature[k] = (norm > 1e-6) ? feature[k] / norm : 0.0;
+			}
+		}
+	}
+}
+
+/** Finds the eigenvectors of the symmetric matrix `a` with the cyclic Jacobi method, destroying `a`.
+Writes the eigenvalues to `values` and the eigenvectors to the rows of `vectors`, unsorted.
+*/
+static void jacobiEigen(double a[FEATURE_HARMONICS][FEATURE_HARMONICS], double values[FEATURE_HARMONICS], double vectors[FEATURE_HARMONICS][FEATURE_HARMONICS]) {
+	const int n = FEATURE_HARMONICS;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			vectors[i][j] = (i == j) ? 1.0 : 0.0;
+		}
+	}
+
+	for (int sweep = 0; sweep < 50; sweep++) {
+		double off = 0.0;
+		for (int p = 0; p < n; p++) {
+			for (int q = p + 1; q < n; q++) {
+				off += a[p][q] * a[p][q];
+			}
+		}
+		if (off < 1e-20)
+			break;
+
+		for (int p = 0; p < n; p++) {
+			for (int q = p + 1; q < n; q++) {
+				if (fabs(a[p][q]) < 1e-30)
+					continue;
+				// Rotate in the p-q plane to zero a[p][q]
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < n; k++) {
+					double akp = a[k][p];
+					double akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < n; k++) {
+					double apk = a[p][k];
+					double aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < n; k++) {
+					double vpk = vectors[p][k];
+					double vqk = vectors[q][k];
+					vectors[p][k] = c * vpk - s * vqk;
+					vectors[q][k] = s * vpk + c * vqk;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		values[i] = a[i][i];
+	}
+}
+
+static void projectFeature(const SimilarIndex *index, const float *feature, float *point) {
+	for (int d = 0; d < SIMILAR_DIMS; d++) {
+		float x = 0.0;
+		for (int k = 0; k < FEATURE_HARMONICS; k++) {
+			x += (feature[k] - index->mean[k]) * index->components[d][k];
+		}
+		point[d] = x;
+	}
+}
+
+static void collectFiles(const CatalogCategory &category, const std::string &path, SimilarIndex *index) {
+	for (const CatalogFile &catalogFile : category.files) {
+		index->files.push_back(&catalogFile);
+		index->categoryNames.push_back(path);
+	}
+	for (const CatalogCategory &subcategory : category.subcategories) {
+		collectFiles(subcategory, path + "/" + subcategory.name, index);
+	}
+}
+
+
+void similarBuild(const std::shared_ptr<const Catalog> &catalog) {
+	std::shared_ptr<SimilarIndex> index = std::make_shared<SimilarIndex>();
+	index->catalog = catalog;
+	for (const std::shared_ptr<const CatalogCategory> &category : *catalog) {
+		collectFiles(*category, category->name, index.get());
+	}
+	int count = index->files.size();
+
+	std::vector<const float*> samples(count);
+	for (int i = 0; i < count; i++) {
+		samples[i] = index->files[i]->samples;
+	}
+	std::vector<float> features(count * FEATURE_HARMONICS);
+	computeFeatures(samples.data(), count, features.data());
+
+	// Principal components of the features
+	double mean[FEATURE_HARMONICS] = {};
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < FEATURE_HARMONICS; k++) {
+			mean[k] += features[i * FEATURE_HARMONICS + k];
+		}
+	}
+	for (int k = 0; k < FEATURE_HARMONICS; k++) {
+		mean[k] /= maxi(count, 1);
+		index->mean[k] = mean[k];
+	}
+	static double covariance[FEATURE_HARMONICS][FEATURE_HARMONICS];
+	static double values[FEATURE_HARMONICS];
+	static double vectors[FEATURE_HARMONICS][FEATURE_HARMONICS];
+	memset(covariance, 0, sizeof(covariance));
+	for (int i = 0; i < count; i++) {
+		double x[FEATURE_HARMONICS];
+		for (int k = 0; k < FEATURE_HARMONICS; k++) {
+			x[k] = features[i * FEATURE_HARMONICS + k] - mean[k];
+		}
+		for (int p = 0; p < FEATURE_HARMONICS; p++) {
+			for (int q = p; q < FEATURE_HARMONICS; q++) {
+				covariance[p][q] += x[p] * x[q];
+			}
+		}
+	}
+	for (int p = 0; p < FEATURE_HARMONICS; p++) {
+		for (int q = 0; q < p; q++) {
+			covariance[p][q] = covariance[q][p];
+		}
+	}
+	jacobiEigen(covariance, values, vectors);
+
+	// Take the components with the largest eigenvalues
+	bool taken[FEATURE_HARMONICS] = {};
+	for (int d = 0; d < SIMILAR_DIMS; d++) {
+		int best = -1;
+		for (int k = 0; k < FEATURE_HARMONICS; k++) {
+			if (!taken[k] && (best < 0 || values[k] > values[best]))
+				best = k;
+		}
+		taken[best] = true;
+		for (int k = 0; k < FEATURE_HARMONICS; k++) {
+			index->components[d][k] = vectors[best][k];
+		}
+	}
+
+	index->points.resize(count * SIMILAR_DIMS);
+	for (int i = 0; i < count; i++) {
+		projectFeature(index.get(), &features[i * FEATURE_HARMONICS], &index->points[i * SIMILAR_DIMS]);
+	}
+
+	std::atomic_store(&similarIndex, std::shared_ptr<const SimilarIndex>(index));
+}
+
+
+int similarFind(const float *samples, SimilarMatch *matches, int k) {
+	std::shared_ptr<const SimilarIndex> index = std::atomic_load(&similarIndex);
+	if (!index || k <= 0)
+		return 0;
+
+	float feature[FEATURE_HARMONICS];
+	computeFeatures(&samples, 1, feature);
+	float query[SIMILAR_DIMS];
+	projectFeature(index.get(), feature, query);
+
+	// Flat scan, keeping the k nearest sorted by distance
+	k = mini(k, SIMILAR_MATCHES_MAX);
+	float bestDistance[SIMILAR_MATCHES_MAX];
+	int bestId[SIMILAR_MATCHES_MAX];
+	int found = 0;
+	int count = index->files.size();
+	const float *points = index->points.data();
+	for (int i = 0; i < count; i++) {
+		const float *point = &points[i * SIMILAR_DIMS];
+		float distance = 0.0;
+		for (int d = 0; d < SIMILAR_DIMS; d++) {
+			float x = point[d] - query[d];
+			distance += x * x;
+		}
+		if (found == k && distance >= bestDistance[k - 1])
+			continue;
+		// Insert into the sorted list
+		int j = (found < k) ? found++ : k - 1;
+		while (j > 0 && bestDistance[j - 1] > distance) {
+			bestDistance[j] = bestDistance[j - 1];
+			bestId[j] = bestId[j - 1];
+			j--;
+		}
+		bestDistance[j] = distance;
+		bestId[j] = i;
+	}
+
+	for (int j = 0; j < found; j++) {
+		matches[j].file = *index->files[bestId[j]];
+		matches[j].categoryName = index->categoryNames[bestId[j]];
+		matches[j].distance = sqrtf(bestDistance[j]);
+	}
+	return found;
+}
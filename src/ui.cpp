@@ -407,6 +407,22 @@ void renderMenu() {
 				historyUndo();
 			if (ImGui::MenuItem("Redo", ImGui::GetIO().OSXBehaviors ? "Cmd+Shift+Z" : "Ctrl+Shift+Z"))
 				historyRedo();
+			if (ImGui::BeginMenu("Undo Memory")) {
+				HistoryStats stats;
+				historyGetStats(&stats);
+				char label[128];
+				snprintf(label, sizeof(label), "%.1f MB, %d states in memory", stats.memoryBytes / 1e6, stats.memoryStates);
+				ImGui::MenuItem(label, NULL, false, false);
+				snprintf(label, sizeof(label), "%.1f MB, %d states on disk", stats.diskBytes / 1e6, stats.diskStates);
+				ImGui::MenuItem(label, NULL, false, false);
+				ImGui::Separator();
+				for (int budget = 4; budget <= 256; budget *= 4) {
+					snprintf(label, sizeof(label), "%d MB", budget);
+					if (ImGui::MenuItem(label, NULL, (budget << 20) == historyBudget))
+						historyBudget = budget << 20;
+				}
+				ImGui::EndMenu();
+			}
 			if (ImGui::MenuItem("Select All", ImGui::GetIO().OSXBehaviors ? "Cmd+A" : "Ctrl+A"))
 				menuSelectAll();
 			ImGui::MenuItem("##spacer", NULL, false, false);
@@ -418,7 +434,31 @@ void renderMenu() {
 			int deviceCount = audioGetDeviceCount();
 			for (int deviceId = 0; deviceId < deviceCount; deviceId++) {
 				const char *deviceName = audioGetDeviceName(deviceId);
-				if (ImGui::MenuItem(deviceName, NULL, false)) audioOpen(deviceId);
+				if (ImGui::MenuItem(deviceName, NULL, deviceId == audioDeviceId)) audioOpen(deviceId);
+			}
+			ImGui::Separator();
+			if (ImGui::BeginMenu("Sample Rate")) {
+				const int sampleRates[] = {44100, 48000, 88200, 96000};
+				for (int sampleRate : sampleRates) {
+					char label[32];
+					snprintf(label, sizeof(label), "%d Hz", sampleRate);
+					if (ImGui::MenuItem(label, NULL, sampleRate == audioSampleRate)) {
+						audioSampleRate = sampleRate;
+						audioOpen(audioDeviceId);
+					}
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Buffer Size")) {
+				for (int bufferSize = 64; bufferSize <= 4096; bufferSize *= 2) {
+					char label[32];
+					snprintf(label, sizeof(label), "%d samples", bufferSize);
+					if (ImGui::MenuItem(label, NULL, bufferSize == audioBufferSize)) {
+						audioBufferSize = bufferSize;
+						audioOpen(audioDeviceId);
+					}
+				}
+				ImGui::EndMenu();
 			}
 			ImGui::EndMenu();
 		}
@@ -456,6 +496,33 @@ void renderMenu() {
 }
 
 
+static void renderAudioStats() {
+	// About one second of callbacks at the smallest buffer size
+	const int window = 512;
+	TimingSummary summary;
+	timingSummarize(&audioTiming, window, &summary);
+	ImGui::Text("Callback time over the last %d: min %.3f ms, avg %.3f ms, max %.3f ms", summary.count, summary.durationMin * 1000.0, summary.durationAvg * 1000.0, summary.durationMax * 1000.0);
+	ImGui::Text("Buffer period used: avg %.1f%%, max %.1f%%. Overruns: %u", summary.loadAvg * 100.0, summary.loadMax * 100.0, summary.overruns);
+
+	static TimingRing::Entry entries[window];
+	static float loads[window];
+	int len = audioTiming.read(entries, window);
+	for (int i = 0; i < len; i++) {
+		loads[i] = entries[i].duration / entries[i].period * 100.0;
+	}
+	ImGui::PushItemWidth(-1.0);
+	ImGui::PlotLines("##audioLoad", loads, len, 0, "Buffer period used (%)", 0.0, 100.0, ImVec2(0, 60.0));
+
+	if (ImGui::Button("Save Stats")) {
+		int sampleRate, bufferSize, channels, bits;
+		if (audioGetSpec(&sampleRate, &bufferSize, &channels, &bits))
+			timingSaveJSON(&audioTiming, "audio", sampleRate, bufferSize, "audiostats.json");
+	}
+	ImGui::SameLine();
+	ImGui::Text("Writes audiostats.json to the working directory");
+}
+
+
 void renderPreview() {
 	ImGui::Checkbox("Play", &playEnabled);
 	ImGui::SameLine();
@@ -485,6 +552,31 @@ void renderPreview() {
 		ImGui::SliderFloat("##Morph Z Speed", &morphZSpeed, 0.f, 10.f, "Morph Z Speed: %.3f Hz", 3.f);
 	}
 
+	// Polyphony
+	{
+		ImGui::PushItemWidth(-1.0);
+		float width = ImGui::CalcItemWidth() / 3.0 - ImGui::GetStyle().FramePadding.y;
+		ImGui::PushItemWidth(width);
+		ImGui::SliderInt("##playVoices", &playVoices, 1, VOICES_MAX, "Voices: %.0f");
+		ImGui::SameLine();
+		ImGui::Combo("##playChord", &playChord, chordNames, CHORDS_LEN);
+		ImGui::SameLine();
+		ImGui::SliderFloat("##playMorphSpread", &playMorphSpread, 0.0, BANK_LEN - 1, "Morph Spread: %.2f");
+	}
+
+	// Negotiated audio format
+	int sampleRate, bufferSize, channels, bits;
+	if (audioGetSpec(&sampleRate, &bufferSize, &channels, &bits)) {
+		ImGui::Text("Audio: %d Hz, %d samples, %d ch, %d bit. Latency: %.1f ms. Jitter: %.2f ms", sampleRate, bufferSize, channels, bits, audioGetLatency() * 1000.0, audioGetJitter() * 1000.0);
+	}
+	else {
+		ImGui::Text("Audio: no output device");
+	}
+
+	if (ImGui::CollapsingHeader("Audio Performance")) {
+		renderAudioStats();
+	}
+
 	refreshMorphSnap();
 }
 
@@ -514,6 +606,25 @@ void effectSlider(EffectID effect) {
 }
 
 
+/** Lists the subcategories of a catalog category as submenus, followed by its files */
+static void renderCatalogCategory(const CatalogCategory &catalogCategory) {
+	for (const CatalogCategory &subcategory : catalogCategory.subcategories) {
+		if (subcategory.empty())
+			continue;
+		if (ImGui::BeginMenu(subcategory.name.c_str())) {
+			renderCatalogCategory(subcategory);
+			ImGui::EndMenu();
+		}
+	}
+	for (const CatalogFile &catalogFile : catalogCategory.files) {
+		if (ImGui::Selectable(catalogFile.name.c_str())) {
+			memcpy(currentBank.waves[selectedId].samples, catalogFile.samples, sizeof(float) * WAVE_LEN);
+			currentBank.waves[selectedId].commitSamples();
+			historyPush();
+		}
+	}
+}
+
 void editorPage() {
 	ImGui::BeginChild("Sidebar", ImVec2(200, 0), true);
 	{
@@ -542,27 +653,46 @@ void editorPage() {
 		}
 
 
-		for (const CatalogCategory &catalogCategory : catalogCategories) {
+		std::shared_ptr<const Catalog> catalog = catalogGet();
+		for (const std::shared_ptr<const CatalogCategory> &catalogCategory : *catalog) {
 			ImGui::SameLine();
-			if (ImGui::Button(catalogCategory.name.c_str())) ImGui::OpenPopup(catalogCategory.name.c_str());
-			if (ImGui::BeginPopup(catalogCategory.name.c_str())) {
-				for (const CatalogFile &catalogFile : catalogCategory.files) {
-					if (ImGui::Selectable(catalogFile.name.c_str())) {
-						memcpy(currentBank.waves[selectedId].samples, catalogFile.samples, sizeof(float) * WAVE_LEN);
-						currentBank.waves[selectedId].commitSamples();
-						historyPush();
-					}
-				}
+			if (ImGui::Button(catalogCategory->name.c_str())) ImGui::OpenPopup(catalogCategory->name.c_str());
+			if (ImGui::BeginPopup(catalogCategory->name.c_str())) {
+				renderCatalogCategory(*catalogCategory);
 				ImGui::EndPopup();
 			}
 		}
 
+		// Catalog waves which sound like the selected wave
+		static SimilarMatch similarMatches[16];
+		static int similarMatchesLen = 0;
+		ImGui::SameLine();
+		if (ImGui::Button("Similar")) {
+			similarMatchesLen = similarFind(wave->samples, similarMatches, 16);
+			ImGui::OpenPopup("Similar");
+		}
+		if (ImGui::BeginPopup("Similar")) {
+			if (similarMatchesLen == 0)
+				ImGui::TextDisabled("The catalog is still loading");
+			for (int i = 0; i < similarMatchesLen; i++) {
+				const SimilarMatch &match = similarMatches[i];
+				char label[256];
+				snprintf(label, sizeof(label), "%s / %s##similar%d", match.categoryName.c_str(), match.file.name.c_str(), i);
+				if (ImGui::Selectable(label)) {
+					memcpy(currentBank.waves[selectedId].samples, match.file.samples, sizeof(float) * WAVE_LEN);
+					currentBank.waves[selectedId].commitSamples();
+					historyPush();
+				}
+			}
+			ImGui::EndPopup();
+		}
+
 		// ImGui::SameLine();
 		// if (ImGui::RadioButton("Smooth", tool == SMOOTH_TOOL)) tool = SMOOTH_TOOL;
 
 		ImGui::Text("Waveform");
 		const int oversample = 4;
-		float waveOversample[WAVE_LEN * oversample];
+		ALIGNED float waveOversample[WAVE_LEN * oversample];
 		cyclicOversample(wave->postSamples, waveOversample, WAVE_LEN, oversample);
 		if (renderWave("WaveEditor", 200.0, wave->samples, WAVE_LEN, waveOversample, WAVE_LEN * oversample, tool)) {
 			currentBank.waves[selectedId].commitSamples();
@@ -637,9 +767,9 @@ void effectHistogram(EffectID effect, Tool tool) {
 			else {
 				currentBank.waves[i].effects[effect] = average;
 			}
-			currentBank.waves[i].updatePost();
-			historyPush();
 		}
+		currentBank.updateAllPost();
+		historyPush();
 	}
 
 	if (renderHistogram(effectNames[effect], 120, value, BANK_LEN, NULL, 0, tool)) {
@@ -649,9 +779,9 @@ void effectHistogram(EffectID effect, Tool tool) {
 				selectWave(i);
 				currentBank.waves[i].effects[effect] = value[i];
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
 		}
+		historyPush();
 	}
 }
 
@@ -670,54 +800,48 @@ void effectPage() {
 		if (ImGui::Button("Cycle All")) {
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].cycle = true;
-				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			currentBank.updateAllPost();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Cycle None")) {
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].cycle = false;
-				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			currentBank.updateAllPost();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Normalize All")) {
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].normalize = true;
-				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			currentBank.updateAllPost();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Normalize None")) {
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].normalize = false;
-				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			currentBank.updateAllPost();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Randomize")) {
-			for (int i = 0; i < BANK_LEN; i++) {
-				currentBank.waves[i].randomizeEffects();
-				historyPush();
-			}
+			currentBank.randomizeEffects();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Reset")) {
-			for (int i = 0; i < BANK_LEN; i++) {
-				currentBank.waves[i].clearEffects();
-				historyPush();
-			}
+			currentBank.clearEffects();
+			historyPush();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Bake")) {
-			for (int i = 0; i < BANK_LEN; i++) {
-				currentBank.waves[i].bakeEffects();
-				historyPush();
-			}
+			currentBank.bakeEffects();
+			historyPush();
 		}
 	}
 	ImGui::EndChild();
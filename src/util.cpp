@@ -26,6 +26,16 @@ void openBrowser(const char *url) {
 }
 
 
+bool renameReplace(const char *from, const char *to) {
+#if defined(_WIN32)
+	// rename() doesn't replace existing files on Windows
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+
 float *loadAudio(const char *filename, int *length) {
 	SF_INFO info;
 	SNDFILE *sf = sf_open(filename, SFM_READ, &info);
@@ -241,3 +251,106 @@ unsigned char * base64_decode(const unsigned char *src, size_t len,
 	*out_len = pos - out;
 	return out;
 }
+
+
+TimingRing::TimingRing() {
+	clear();
+}
+
+void TimingRing::clear() {
+	head = 0;
+	overruns = 0;
+}
+
+void TimingRing::push(float duration, float period) {
+	uint32_t h = head.load(std::memory_order_relaxed);
+	entries[h % TIMING_RING_LEN].duration = duration;
+	entries[h % TIMING_RING_LEN].period = period;
+	if (duration > period)
+		overruns.fetch_add(1, std::memory_order_relaxed);
+	// Publish the entry after writing it
+	head.store(h + 1, std::memory_order_release);
+}
+
+int TimingRing::read(Entry *out, int len) const {
+	uint32_t h = head.load(std::memory_order_acquire);
+	len = mini(len, h < TIMING_RING_LEN ? h : TIMING_RING_LEN);
+	for (int i = 0; i < len; i++) {
+		out[i] = entries[(h - len + i) % TIMING_RING_LEN];
+	}
+	// Drop entries the producer may have overwritten while they were copied, including the one it may be writing now
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint32_t h2 = head.load(std::memory_order_relaxed);
+	int overwritten = clampi((int) (h2 + 1 - h) - (TIMING_RING_LEN - len), 0, len);
+	if (overwritten > 0) {
+		memmove(out, out + overwritten, sizeof(Entry) * (len - overwritten));
+		len -= overwritten;
+	}
+	return len;
+}
+
+
+static void summarizeEntries(const TimingRing::Entry *entries, int len, TimingSummary *summary) {
+	summary->count = len;
+	summary->durationMin = len > 0 ? entries[0].duration : 0.0;
+	summary->durationAvg = 0.0;
+	summary->durationMax = 0.0;
+	summary->loadAvg = 0.0;
+	summary->loadMax = 0.0;
+	for (int i = 0; i < len; i++) {
+		float load = entries[i].duration / entries[i].period;
+		summary->durationMin = fminf(summary->durationMin, entries[i].duration);
+		summary->durationAvg += entries[i].duration / len;
+		summary->durationMax = fmaxf(summary->durationMax, entries[i].duration);
+		summary->loadAvg += load / len;
+		summary->loadMax = fmaxf(summary->loadMax, load);
+	}
+}
+
+void timingSummarize(const TimingRing *ring, int window, TimingSummary *summary) {
+	TimingRing::Entry entries[TIMING_RING_LEN];
+	int len = ring->read(entries, mini(window, TIMING_RING_LEN));
+	summarizeEntries(entries, len, summary);
+	summary->overruns = ring->overruns;
+}
+
+
+bool timingSaveJSON(const TimingRing *ring, const char *label, int sampleRate, int bufferSize, const char *filename) {
+	FILE *f = fopen(filename, "w");
+	if (!f)
+		return false;
+
+	TimingRing::Entry entries[TIMING_RING_LEN];
+	int len = ring->read(entries, TIMING_RING_LEN);
+	TimingSummary summary;
+	summarizeEntries(entries, len, &summary);
+	summary.overruns = ring->overruns;
+
+	// Times are in microseconds
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"label\": \"%s\",\n", label);
+	fprintf(f, "\t\"version\": \"%s\",\n", TOSTRING(VERSION));
+	fprintf(f, "\t\"sampleRate\": %d,\n", sampleRate);
+	fprintf(f, "\t\"bufferSize\": %d,\n", bufferSize);
+	fprintf(f, "\t\"count\": %d,\n", summary.count);
+	fprintf(f, "\t\"durationMin\": %.3f,\n", summary.durationMin * 1e6);
+	fprintf(f, "\t\"durationAvg\": %.3f,\n", summary.durationAvg * 1e6);
+	fprintf(f, "\t\"durationMax\": %.3f,\n", summary.durationMax * 1e6);
+	fprintf(f, "\t\"loadAvg\": %.6f,\n", summary.loadAvg);
+	fprintf(f, "\t\"loadMax\": %.6f,\n", summary.loadMax);
+	fprintf(f, "\t\"overruns\": %u,\n", summary.overruns);
+	fprintf(f, "\t\"durations\": [");
+	for (int i = 0; i < len; i++) {
+		fprintf(f, "%s%.3f", i > 0 ? ", " : "", entries[i].duration * 1e6);
+	}
+	fprintf(f, "],\n");
+	fprintf(f, "\t\"periods\": [");
+	for (int i = 0; i < len; i++) {
+		fprintf(f, "%s%.3f", i > 0 ? ", " : "", entries[i].period * 1e6);
+	}
+	fprintf(f, "]\n");
+	fprintf(f, "}\n");
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+/** Vectorized float kernels, written once against an instruction set wrapper `O` and instantiated for SSE2 in math.cpp and for AVX2 in math_avx2.cpp.
+Everything here has internal linkage, so AVX2 code can never be linked in place of the SSE2 code.
+Only include intrinsic headers before this file.
+Translation units including this must be compiled with -fno-associative-math, or the Cody-Waite reduction in vecSin() loses its precision.
+*/
+
+#include <string.h>
+
+
+/** Polynomial approximation of sin(r) on [-pi/2, pi/2], Taylor series to r^11 */
+template <class O>
+static inline typename O::V vecSinReduced(typename O::V r) {
+	typedef typename O::V V;
+	V r2 = O::mul(r, r);
+	V p = O::set1(-2.5052108e-8f);
+	p = O::add(O::mul(p, r2), O::set1(2.7557319e-6f));
+	p = O::add(O::mul(p, r2), O::set1(-1.9841270e-4f));
+	p = O::add(O::mul(p, r2), O::set1(8.3333333e-3f));
+	p = O::add(O::mul(p, r2), O::set1(-1.6666667e-1f));
+	return O::add(O::mul(O::mul(p, r2), r), r);
+}
+
+/** Polynomial approximation of cos(r) on [-pi/2, pi/2], Taylor series to r^12 */
+template <class O>
+static inline typename O::V vecCosReduced(typename O::V r) {
+	typedef typename O::V V;
+	V r2 = O::mul(r, r);
+	V p = O::set1(2.0876757e-9f);
+	p = O::add(O::mul(p, r2), O::set1(-2.7557319e-7f));
+	p = O::add(O::mul(p, r2), O::set1(2.4801587e-5f));
+	p = O::add(O::mul(p, r2), O::set1(-1.3888889e-3f));
+	p = O::add(O::mul(p, r2), O::set1(4.1666667e-2f));
+	p = O::add(O::mul(p, r2), O::set1(-0.5f));
+	return O::add(O::mul(p, r2), O::set1(1.f));
+}
+
+/** Flips the sign of `x` where the integer `k` is odd */
+template <class O>
+static inline typename O::V vecFlipOdd(typename O::V x, typename O::I k) {
+	return O::bitXor(x, O::oddSignMask(k));
+}
+
+/** sin(x) for x in radians.
+Reduces by the nearest multiple of pi in three parts (Cody-Waite), so the error stays below 2e-7 for |x| < 1000.
+*/
+template <class O>
+static inline typename O::V vecSin(typename O::V x) {
+	typedef typename O::V V;
+	typedef typename O::I I;
+	I k = O::roundToInt(O::mul(x, O::set1(0.31830988618f)));
+	V kf = O::toFloat(k);
+	V r = O::sub(x, O::mul(kf, O::set1(3.140625f)));
+	r = O::sub(r, O::mul(kf, O::set1(9.67502593994140625e-4f)));
+	r = O::sub(r, O::mul(kf, O::set1(1.509957990978376432e-7f)));
+	return vecFlipOdd<O>(vecSinReduced<O>(r), k);
+}
+
+/** sin(2 pi x) and cos(2 pi x) for x in turns.
+The reduction by the nearest half turn is exact, so the error is below 2e-7 for any |x| < 2^22.
+*/
+template <class O>
+static inline void vecSinCos2pi(typename O::V x, typename O::V *s, typename O::V *c) {
+	typedef typename O::V V;
+	typedef typename O::I I;
+	I k = O::roundToInt(O::add(x, x));
+	V r = O::sub(x, O::mul(O::toFloat(k), O::set1(0.5f)));
+	r = O::mul(r, O::set1(6.28318530718f));
+	*s = vecFlipOdd<O>(vecSinReduced<O>(r), k);
+	*c = vecFlipOdd<O>(vecCosReduced<O>(r), k);
+}
+
+/** asin(x) for |x| <= 1, using the polynomial from Cephes' asinf.
+Absolute error is below 3e-7.
+*/
+template <class O>
+static inline typename O::V vecAsin(typename O::V x) {
+	typedef typename O::V V;
+	V sign = O::bitAnd(x, O::set1(-0.f));
+	V a = O::bitXor(x, sign);
+	V big = O::greater(a, O::set1(0.5f));
+	// For |x| > 0.5, use asin(x) = pi/2 - 2 asin(sqrt((1 - |x|) / 2))
+	V zBig = O::mul(O::set1(0.5f), O::sub(O::set1(1.f), a));
+	V z = O::select(big, zBig, O::mul(a, a));
+	V s = O::select(big, O::sqrt(zBig), a);
+	V p = O::set1(4.2163199048e-2f);
+	p = O::add(O::mul(p, z), O::set1(2.4181311049e-2f));
+	p = O::add(O::mul(p, z), O::set1(4.5470025998e-2f));
+	p = O::add(O::mul(p, z), O::set1(7.4953002686e-2f));
+	p = O::add(O::mul(p, z), O::set1(1.6666752422e-1f));
+	p = O::add(O::mul(O::mul(p, z), s), s);
+	V r = O::select(big, O::sub(O::set1(1.57079632679f), O::add(p, p)), p);
+	return O::bitOr(r, sign);
+}
+
+/** Rounds half away from zero like roundf(), which plain SSE2 conversion does not */
+template <class O>
+static inline typename O::V vecRound(typename O::V x) {
+	typedef typename O::V V;
+	// Conversion rounds half to even
+	V r = O::toFloat(O::roundToInt(x));
+	V d = O::sub(x, r);
+	V zero = O::set1(0.f);
+	V up = O::bitAnd(O::equal(d, O::set1(0.5f)), O::greater(x, zero));
+	V down = O::bitAnd(O::equal(d, O::set1(-0.5f)), O::greater(zero, x));
+	r = O::add(r, O::bitAnd(up, O::set1(1.f)));
+	r = O::sub(r, O::bitAnd(down, O::set1(1.f)));
+	// Floats this large are already integers, and may not fit in an int
+	V large = O::greater(O::bitAndNot(O::set1(-0.f), x), O::set1(8388608.f));
+	return O::select(large, x, r);
+}
+
+
+/** Applies `f` to `len` floats, padding the last partial vector with zeros */
+template <class O, class F>
+static inline void vecMap(const float *in, float *out, int len, F f) {
+	const int W = O::WIDTH;
+	int i = 0;
+	for (; i + W <= len; i += W) {
+		O::store(&out[i], f(O::load(&in[i])));
+	}
+	if (i < len) {
+		float tmpIn[W] = {};
+		float tmpOut[W];
+		memcpy(tmpIn, &in[i], sizeof(float) * (len - i));
+		O::store(tmpOut, f(O::load(tmpIn)));
+		memcpy(&out[i], tmpOut, sizeof(float) * (len - i));
+	}
+}
+
+template <class O>
+static inline void vecSinArray(const float *x, float *out, int len) {
+	vecMap<O>(x, out, len, vecSin<O>);
+}
+
+template <class O>
+static inline void vecSin2piArray(const float *x, float *out, int len) {
+	vecMap<O>(x, out, len, [](typename O::V v) {
+		typename O::V s, c;
+		vecSinCos2pi<O>(v, &s, &c);
+		return s;
+	});
+}
+
+template <class O>
+static inline void vecSinCos2piArray(const float *x, float *outSin, float *outCos, int len) {
+	const int W = O::WIDTH;
+	int i = 0;
+	for (; i + W <= len; i += W) {
+		typename O::V s, c;
+		vecSinCos2pi<O>(O::load(&x[i]), &s, &c);
+		O::store(&outSin[i], s);
+		O::store(&outCos[i], c);
+	}
+	if (i < len) {
+		float tmpIn[W] = {};
+		float tmpSin[W];
+		float tmpCos[W];
+		memcpy(tmpIn, &x[i], sizeof(float) * (len - i));
+		typename O::V s, c;
+		vecSinCos2pi<O>(O::load(tmpIn), &s, &c);
+		O::store(tmpSin, s);
+		O::store(tmpCos, c);
+		memcpy(&outSin[i], tmpSin, sizeof(float) * (len - i));
+		memcpy(&outCos[i], tmpCos, sizeof(float) * (len - i));
+	}
+}
+
+template <class O>
+static inline void vecAsinArray(const float *x, float *out, int len) {
+	vecMap<O>(x, out, len, vecAsin<O>);
+}
+
+template <class O>
+static inline void vecRoundArray(const float *x, float *out, int len) {
+	vecMap<O>(x, out, len, vecRound<O>);
+}
+
+/** Magnitudes of `len` interleaved complex numbers */
+template <class O>
+static inline void vecCabsArray(const float *z, float *out, int len) {
+	const int W = O::WIDTH;
+	int i = 0;
+	for (; i + W <= len; i += W) {
+		typename O::V a = O::load(&z[2 * i]);
+		typename O::V b = O::load(&z[2 * i + W]);
+		typename O::V sum = O::pairSum(O::mul(a, a), O::mul(b, b));
+		O::store(&out[i], O::sqrt(sum));
+	}
+	if (i < len) {
+		float tmpIn[2 * W] = {};
+		float tmpOut[W];
+		memcpy(tmpIn, &z[2 * i], sizeof(float) * 2 * (len - i));
+		typename O::V a = O::load(&tmpIn[0]);
+		typename O::V b = O::load(&tmpIn[W]);
+		O::store(tmpOut, O::sqrt(O::pairSum(O::mul(a, a), O::mul(b, b))));
+		memcpy(&out[i], tmpOut, sizeof(float) * (len - i));
+	}
+}
+
+
+// AVX2 entry points, defined in math_avx2.cpp
+
+void sinvAVX2(const float *x, float *out, int len);
+void sin2pivAVX2(const float *x, float *out, int len);
+void sincos2pivAVX2(const float *x, float *outSin, float *outCos, int len);
+void asinvAVX2(const float *x, float *out, int len);
+void roundvAVX2(const float *x, float *out, int len);
+void cabsvAVX2(const float *z, float *out, int len);
@@ -1,6 +1,7 @@
 #include "WaveEdit.hpp"
 #include <string.h>
 #include <sndfile.h>
+#include <mutex>
 
 
 static Wave clipboardWave = {};
@@ -23,197 +24,407 @@ const char *effectNames[EFFECTS_LEN] {
 };
 
 
+/** Stages of the effect chain, in order */
+enum PostStage {
+	PRE_GAIN_STAGE,
+	SHIFT_STAGE,
+	COMB_STAGE,
+	RING_STAGE,
+	CHEBYSHEV_STAGE,
+	SAMPLE_AND_HOLD_STAGE,
+	QUANTIZATION_STAGE,
+	SLEW_STAGE,
+	FILTER_STAGE,
+	POST_GAIN_STAGE,
+	CYCLE_STAGE,
+	/** Also hard clips */
+	NORMALIZE_STAGE,
+	POST_STAGES_LEN
+};
+
+/** Inputs and per-stage outputs of the last effect chain evaluation of a wave, so that only the stages after a changed parameter are rerun.
+Kept outside of Wave so that copies of banks in the history and files don't carry it.
+*/
+struct PostCache {
+	std::mutex mutex;
+	/** The wave this cache was last used for */
+	const Wave *wave = NULL;
+	float samples[WAVE_LEN];
+	float effects[EFFECTS_LEN];
+	bool cycle;
+	bool normalize;
+	/** Output of each stage */
+	float stages[POST_STAGES_LEN][WAVE_LEN];
+};
+
+/** Enough for currentBank and the import preview bank */
+#define POST_CACHES_LEN (2 * BANK_LEN)
+static PostCache postCaches[POST_CACHES_LEN];
+
+
 void Wave::clear() {
 	memset(this, 0, sizeof(Wave));
 }
 
 void Wave::updatePost() {
-	float out[WAVE_LEN];
-	memcpy(out, samples, sizeof(float) * WAVE_LEN);
-
-	// Pre-gain
-	if (effects[PRE_GAIN]) {
-		float gain = powf(20.0, effects[PRE_GAIN]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] *= gain;
-		}
-	}
+	updatePostSamples();
+	// Convert wave to spectrum
+	RFFT(postSamples, postSpectrum, WAVE_LEN);
+	updatePostHarmonics();
+}
 
-	// Temporal and Harmonic Shift
-	if (effects[PHASE_SHIFT] > 0.0 || effects[HARMONIC_SHIFT] > 0.0) {
-		// Shift Fourier phase proportionally
-		float tmp[WAVE_LEN];
-		RFFT(out, tmp, WAVE_LEN);
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
-			float phase = clampf(effects[HARMONIC_SHIFT], 0.0, 1.0) + clampf(effects[PHASE_SHIFT], 0.0, 1.0) * k;
-			float br = cosf(2 * M_PI * phase);
-			float bi = -sinf(2 * M_PI * phase);
-			cmultf(&tmp[2 * k], &tmp[2 * k + 1], tmp[2 * k], tmp[2 * k + 1], br, bi);
-		}
-		IRFFT(tmp, out, WAVE_LEN);
-	}
+#define COMB_TAPS 40
 
-	// Comb filter
-	if (effects[COMB] > 0.0) {
-		const float base = 0.75;
-		const int taps = 40;
-
-		// Build the kernel in Fourier space
-		// Place taps at positions `comb * j`, with exponentially decreasing amplitude
-		float kernel[WAVE_LEN] = {};
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
-			for (int j = 0; j < taps; j++) {
-				float amplitude = powf(base, j);
-				// Normalize by sum of geometric series
-				amplitude *= (1.0 - base);
-				float phase = -2.0 * M_PI * k * effects[COMB] * j;
-				kernel[2 * k] += amplitude * cosf(phase);
-				kernel[2 * k + 1] += amplitude * sinf(phase);
-			}
-		}
+/** Comb parameters are quantized to steps of 1 / COMB_RESOLUTION, the resolution the effect slider displays.
+This lets nearly equal values share a cache entry, and reduces every tap phase exactly with integer arithmetic.
+*/
+#define COMB_RESOLUTION 1000
 
-		// Convolve FFT of input with kernel
-		float fft[WAVE_LEN];
-		RFFT(out, fft, WAVE_LEN);
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
-			cmultf(&fft[2 * k], &fft[2 * k + 1], fft[2 * k], fft[2 * k + 1], kernel[2 * k], kernel[2 * k + 1]);
-		}
-		IRFFT(fft, out, WAVE_LEN);
-	}
+/** Recently used comb filter kernels, shared by all waves */
+struct CombKernel {
+	int step;
+	/** Value of combKernelsTime when last used, or 0 if unused */
+	uint64_t lastUsed = 0;
+	float kernel[WAVE_LEN];
+};
 
-	// Ring modulation
-	if (effects[RING] > 0.0) {
-		float ring = ceilf(powf(effects[RING], 2) * (WAVE_LEN / 2 - 2));
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float phase = (float)i / WAVE_LEN * ring;
-			out[i] *= sinf(2 * M_PI * phase);
-		}
-	}
+/** Enough kernels for every wave of a bank to use a different value */
+#define COMB_KERNELS_LEN BANK_LEN
+static std::mutex combKernelsMutex;
+static CombKernel combKernels[COMB_KERNELS_LEN];
+static uint64_t combKernelsTime = 0;
 
-	// Chebyshev waveshaping
-	if (effects[CHEBYSHEV] > 0.0) {
-		float n = powf(50.0, effects[CHEBYSHEV]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			// Apply a distant variant of the Chebyshev polynomial of the first kind
-			if (-1.0 <= out[i] && out[i] <= 1.0)
-				out[i] = sinf(n * asinf(out[i]));
-			else
-				out[i] = sinf(n * asinf(1.0 / out[i]));
+/** Tap amplitudes decrease exponentially, normalized by the sum of the geometric series */
+static const struct CombAmplitudes {
+	float a[COMB_TAPS];
+	CombAmplitudes() {
+		const float base = 0.75;
+		for (int j = 0; j < COMB_TAPS; j++) {
+			a[j] = powf(base, j) * (1.0 - base);
 		}
 	}
-
-	// Sample & Hold
-	if (effects[SAMPLE_AND_HOLD] > 0.0) {
-		float frameskip = powf(WAVE_LEN / 2.0, clampf(effects[SAMPLE_AND_HOLD], 0.0, 1.0));
-		float tmp[WAVE_LEN + 1];
-		memcpy(tmp, out, sizeof(float) * WAVE_LEN);
-		tmp[WAVE_LEN] = tmp[0];
-
-		// Dumb linear interpolation S&H
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float index = roundf(i / frameskip) * frameskip;
-			out[i] = linterpf(tmp, clampf(index, 0.0, WAVE_LEN - 1));
+} combAmplitudes;
+
+/** Writes the Fourier-space kernel of the comb filter with parameter `comb` to `kernel`, reusing a cached kernel if possible */
+static void getCombKernel(float comb, float *kernel) {
+	int step = roundf(comb * COMB_RESOLUTION);
+	{
+		std::lock_guard<std::mutex> lock(combKernelsMutex);
+		for (int i = 0; i < COMB_KERNELS_LEN; i++) {
+			CombKernel *entry = &combKernels[i];
+			if (entry->lastUsed > 0 && entry->step == step) {
+				entry->lastUsed = ++combKernelsTime;
+				memcpy(kernel, entry->kernel, sizeof(float) * WAVE_LEN);
+				return;
+			}
 		}
 	}
 
-	// Quantization
-	if (effects[QUANTIZATION] > 1e-3) {
-		float levels = powf(clampf(effects[QUANTIZATION], 0.0, 1.0), -1.5);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] = roundf(out[i] * levels) / levels;
+	// Build the kernel in Fourier space without holding the lock, so waves with different values can be built in parallel
+	// Place taps at positions `comb * j`, so tap j of harmonic k has phase -k * comb * j cycles
+	for (int k = 0; k < WAVE_LEN / 2; k++) {
+		ALIGNED float phase[COMB_TAPS];
+		for (int j = 0; j < COMB_TAPS; j++) {
+			phase[j] = -(float) ((k * j * step) % COMB_RESOLUTION) / COMB_RESOLUTION;
+		}
+		ALIGNED float s[COMB_TAPS];
+		ALIGNED float c[COMB_TAPS];
+		sincos2piv(phase, s, c, COMB_TAPS);
+		float re = 0.0;
+		float im = 0.0;
+		for (int j = 0; j < COMB_TAPS; j++) {
+			re += combAmplitudes.a[j] * c[j];
+			im += combAmplitudes.a[j] * s[j];
 		}
+		kernel[2 * k] = re;
+		kernel[2 * k + 1] = im;
 	}
 
-	// Slew Limiter
-	if (effects[SLEW] > 0.0) {
-		float slew = powf(0.001, effects[SLEW]);
-
-		float y = out[0];
-		for (int i = 1; i < WAVE_LEN; i++) {
-			float dxdt = out[i] - y;
-			float dydt = clampf(dxdt, -slew, slew);
-			y += dydt;
-			out[i] = y;
-		}
+	// Replace the least recently used kernel
+	std::lock_guard<std::mutex> lock(combKernelsMutex);
+	CombKernel *lru = &combKernels[0];
+	for (int i = 1; i < COMB_KERNELS_LEN; i++) {
+		if (combKernels[i].lastUsed < lru->lastUsed)
+			lru = &combKernels[i];
 	}
+	lru->step = step;
+	lru->lastUsed = ++combKernelsTime;
+	memcpy(lru->kernel, kernel, sizeof(float) * WAVE_LEN);
+}
 
-	// Brick-wall lowpass / highpass filter
-	// TODO Maybe change this into a more musical filter
-	if (effects[LOWPASS] > 0.0 || effects[HIGHPASS]) {
-		float fft[WAVE_LEN];
-		RFFT(out, fft, WAVE_LEN);
-		float lowpass = 1.0 - effects[LOWPASS];
-		float highpass = effects[HIGHPASS];
-		for (int i = 1; i < WAVE_LEN / 2; i++) {
-			float v = clampf(WAVE_LEN / 2 * lowpass - i, 0.0, 1.0) * clampf(-WAVE_LEN / 2 * highpass + i, 0.0, 1.0);
-			fft[2 * i] *= v;
-			fft[2 * i + 1] *= v;
-		}
-		IRFFT(fft, out, WAVE_LEN);
+/** Applies stage `stage` of the effect chain of `wave` to `out` in place */
+static void applyStage(const Wave *wave, int stage, float *out) {
+	const float *effects = wave->effects;
+	switch (stage) {
+		case PRE_GAIN_STAGE: {
+			// Pre-gain
+			if (effects[PRE_GAIN]) {
+				float gain = powf(20.0, effects[PRE_GAIN]);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] *= gain;
+				}
+			}
+		} break;
+		case SHIFT_STAGE: {
+			// Temporal and Harmonic Shift
+			if (effects[PHASE_SHIFT] > 0.0 || effects[HARMONIC_SHIFT] > 0.0) {
+				// Shift Fourier phase proportionally
+				ALIGNED float tmp[WAVE_LEN];
+				RFFT(out, tmp, WAVE_LEN);
+				ALIGNED float phase[WAVE_LEN / 2];
+				for (int k = 0; k < WAVE_LEN / 2; k++) {
+					phase[k] = clampf(effects[HARMONIC_SHIFT], 0.0, 1.0) + clampf(effects[PHASE_SHIFT], 0.0, 1.0) * k;
+				}
+				ALIGNED float s[WAVE_LEN / 2];
+				ALIGNED float c[WAVE_LEN / 2];
+				sincos2piv(phase, s, c, WAVE_LEN / 2);
+				for (int k = 0; k < WAVE_LEN / 2; k++) {
+					cmultf(&tmp[2 * k], &tmp[2 * k + 1], tmp[2 * k], tmp[2 * k + 1], c[k], -s[k]);
+				}
+				IRFFT(tmp, out, WAVE_LEN);
+			}
+		} break;
+		case COMB_STAGE: {
+			// Comb filter
+			if (effects[COMB] > 0.0) {
+				ALIGNED float kernel[WAVE_LEN];
+				getCombKernel(effects[COMB], kernel);
+
+				// Convolve FFT of input with kernel
+				ALIGNED float fft[WAVE_LEN];
+				RFFT(out, fft, WAVE_LEN);
+				for (int k = 0; k < WAVE_LEN / 2; k++) {
+					cmultf(&fft[2 * k], &fft[2 * k + 1], fft[2 * k], fft[2 * k + 1], kernel[2 * k], kernel[2 * k + 1]);
+				}
+				IRFFT(fft, out, WAVE_LEN);
+			}
+		} break;
+		case RING_STAGE: {
+			// Ring modulation
+			if (effects[RING] > 0.0) {
+				float ring = ceilf(powf(effects[RING], 2) * (WAVE_LEN / 2 - 2));
+				ALIGNED float carrier[WAVE_LEN];
+				for (int i = 0; i < WAVE_LEN; i++) {
+					carrier[i] = (float)i / WAVE_LEN * ring;
+				}
+				sin2piv(carrier, carrier, WAVE_LEN);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] *= carrier[i];
+				}
+			}
+		} break;
+		case CHEBYSHEV_STAGE: {
+			// Chebyshev waveshaping
+			if (effects[CHEBYSHEV] > 0.0) {
+				float n = powf(50.0, effects[CHEBYSHEV]);
+				// Apply a distant variant of the Chebyshev polynomial of the first kind
+				for (int i = 0; i < WAVE_LEN; i++) {
+					if (!(-1.0 <= out[i] && out[i] <= 1.0))
+						out[i] = 1.0 / out[i];
+				}
+				asinv(out, out, WAVE_LEN);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] *= n;
+				}
+				sinv(out, out, WAVE_LEN);
+			}
+		} break;
+		case SAMPLE_AND_HOLD_STAGE: {
+			// Sample & Hold
+			if (effects[SAMPLE_AND_HOLD] > 0.0) {
+				float frameskip = powf(WAVE_LEN / 2.0, clampf(effects[SAMPLE_AND_HOLD], 0.0, 1.0));
+				float tmp[WAVE_LEN + 1];
+				memcpy(tmp, out, sizeof(float) * WAVE_LEN);
+				tmp[WAVE_LEN] = tmp[0];
+
+				// Dumb linear interpolation S&H
+				for (int i = 0; i < WAVE_LEN; i++) {
+					float index = roundf(i / frameskip) * frameskip;
+					out[i] = linterpf(tmp, clampf(index, 0.0, WAVE_LEN - 1));
+				}
+			}
+		} break;
+		case QUANTIZATION_STAGE: {
+			// Quantization
+			if (effects[QUANTIZATION] > 1e-3) {
+				float levels = powf(clampf(effects[QUANTIZATION], 0.0, 1.0), -1.5);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] *= levels;
+				}
+				roundv(out, out, WAVE_LEN);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] /= levels;
+				}
+			}
+		} break;
+		case SLEW_STAGE: {
+			// Slew Limiter
+			if (effects[SLEW] > 0.0) {
+				float slew = powf(0.001, effects[SLEW]);
+
+				float y = out[0];
+				for (int i = 1; i < WAVE_LEN; i++) {
+					float dxdt = out[i] - y;
+					float dydt = clampf(dxdt, -slew, slew);
+					y += dydt;
+					out[i] = y;
+				}
+			}
+		} break;
+		case FILTER_STAGE: {
+			// Brick-wall lowpass / highpass filter
+			// TODO Maybe change this into a more musical filter
+			if (effects[LOWPASS] > 0.0 || effects[HIGHPASS]) {
+				ALIGNED float fft[WAVE_LEN];
+				RFFT(out, fft, WAVE_LEN);
+				float lowpass = 1.0 - effects[LOWPASS];
+				float highpass = effects[HIGHPASS];
+				for (int i = 1; i < WAVE_LEN / 2; i++) {
+					float v = clampf(WAVE_LEN / 2 * lowpass - i, 0.0, 1.0) * clampf(-WAVE_LEN / 2 * highpass + i, 0.0, 1.0);
+					fft[2 * i] *= v;
+					fft[2 * i + 1] *= v;
+				}
+				IRFFT(fft, out, WAVE_LEN);
+			}
+		} break;
+		case POST_GAIN_STAGE: {
+			// TODO Consider removing because Normalize does this for you
+			// Post gain
+			if (effects[POST_GAIN]) {
+				float gain = powf(20.0, effects[POST_GAIN]);
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] *= gain;
+				}
+			}
+		} break;
+		case CYCLE_STAGE: {
+			// Cycle
+			if (wave->cycle) {
+				float start = out[0];
+				float end = out[WAVE_LEN - 1] / (WAVE_LEN - 1) * WAVE_LEN;
+
+				for (int i = 0; i < WAVE_LEN; i++) {
+					out[i] -= (end - start) * (i - WAVE_LEN / 2) / WAVE_LEN;
+				}
+			}
+		} break;
+		case NORMALIZE_STAGE: {
+			// Normalize
+			if (wave->normalize) {
+				float max = -INFINITY;
+				float min = INFINITY;
+				for (int i = 0; i < WAVE_LEN; i++) {
+					if (out[i] > max) max = out[i];
+					if (out[i] < min) min = out[i];
+				}
+
+				if (max - min >= 1e-6) {
+					for (int i = 0; i < WAVE_LEN; i++) {
+						out[i] = rescalef(out[i], min, max, -1.0, 1.0);
+					}
+				}
+				else {
+					memset(out, 0, sizeof(float) * WAVE_LEN);
+				}
+			}
+
+			// Hard clip :(
+			for (int i = 0; i < WAVE_LEN; i++) {
+				out[i] = clampf(out[i], -1.0, 1.0);
+			}
+		} break;
+		default: break;
 	}
+}
 
-	// TODO Consider removing because Normalize does this for you
-	// Post gain
-	if (effects[POST_GAIN]) {
-		float gain = powf(20.0, effects[POST_GAIN]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] *= gain;
-		}
+/** Returns whether the parameters used by `stage` differ from the ones recorded in `cache` */
+static bool stageChanged(const Wave *wave, int stage, const PostCache *cache) {
+	const float *effects = wave->effects;
+	const float *cached = cache->effects;
+	switch (stage) {
+		case PRE_GAIN_STAGE: return effects[PRE_GAIN] != cached[PRE_GAIN];
+		case SHIFT_STAGE: return effects[PHASE_SHIFT] != cached[PHASE_SHIFT] || effects[HARMONIC_SHIFT] != cached[HARMONIC_SHIFT];
+		case COMB_STAGE: return effects[COMB] != cached[COMB];
+		case RING_STAGE: return effects[RING] != cached[RING];
+		case CHEBYSHEV_STAGE: return effects[CHEBYSHEV] != cached[CHEBYSHEV];
+		case SAMPLE_AND_HOLD_STAGE: return effects[SAMPLE_AND_HOLD] != cached[SAMPLE_AND_HOLD];
+		case QUANTIZATION_STAGE: return effects[QUANTIZATION] != cached[QUANTIZATION];
+		case SLEW_STAGE: return effects[SLEW] != cached[SLEW];
+		case FILTER_STAGE: return effects[LOWPASS] != cached[LOWPASS] || effects[HIGHPASS] != cached[HIGHPASS];
+		case POST_GAIN_STAGE: return effects[POST_GAIN] != cached[POST_GAIN];
+		case CYCLE_STAGE: return wave->cycle != cache->cycle;
+		case NORMALIZE_STAGE: return wave->normalize != cache->normalize;
+		default: return true;
 	}
+}
 
-	// Cycle
-	if (cycle) {
-		float start = out[0];
-		float end = out[WAVE_LEN - 1] / (WAVE_LEN - 1) * WAVE_LEN;
+void Wave::updatePostSamples() {
+	// Waves of the same bank are consecutive in memory, so they never share a slot
+	PostCache *cache = &postCaches[((uintptr_t) this / sizeof(Wave)) % POST_CACHES_LEN];
+	std::lock_guard<std::mutex> lock(cache->mutex);
 
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] -= (end - start) * (i - WAVE_LEN / 2) / WAVE_LEN;
-		}
+	// The cache may belong to another wave, or hold garbage if it has never been used
+	bool cacheValid = cache->wave == this;
+	bool changed[POST_STAGES_LEN];
+	for (int stage = 0; stage < POST_STAGES_LEN; stage++) {
+		changed[stage] = !cacheValid || stageChanged(this, stage, cache);
 	}
 
-	// Normalize
-	if (normalize) {
-		float max = -INFINITY;
-		float min = INFINITY;
-		for (int i = 0; i < WAVE_LEN; i++) {
-			if (out[i] > max) max = out[i];
-			if (out[i] < min) min = out[i];
-		}
+	// Find the first stage that must be rerun
+	int stage = 0;
+	if (cacheValid && memcmp(cache->samples, samples, sizeof(float) * WAVE_LEN) == 0) {
+		while (stage < POST_STAGES_LEN && !changed[stage])
+			stage++;
+	}
 
-		if (max - min >= 1e-6) {
-			for (int i = 0; i < WAVE_LEN; i++) {
-				out[i] = rescalef(out[i], min, max, -1.0, 1.0);
-			}
-		}
-		else {
-			memset(out, 0, sizeof(float) * WAVE_LEN);
+	ALIGNED float out[WAVE_LEN];
+	if (stage < POST_STAGES_LEN)
+		memcpy(out, stage == 0 ? samples : cache->stages[stage - 1], sizeof(float) * WAVE_LEN);
+	while (stage < POST_STAGES_LEN) {
+		applyStage(this, stage, out);
+		bool same = memcmp(out, cache->stages[stage], sizeof(float) * WAVE_LEN) == 0;
+		if (!same)
+			memcpy(cache->stages[stage], out, sizeof(float) * WAVE_LEN);
+		stage++;
+		if (same) {
+			// The next stage's input is bit-identical, so the cached results are good until the next stage with changed parameters
+			while (stage < POST_STAGES_LEN && !changed[stage])
+				stage++;
+			// Continue from the cached output of the last skipped stage, not this one
+			if (stage < POST_STAGES_LEN)
+				memcpy(out, cache->stages[stage - 1], sizeof(float) * WAVE_LEN);
 		}
 	}
 
-	// Hard clip :(
-	for (int i = 0; i < WAVE_LEN; i++) {
-		out[i] = clampf(out[i], -1.0, 1.0);
-	}
+	memcpy(cache->samples, samples, sizeof(float) * WAVE_LEN);
+	memcpy(cache->effects, effects, sizeof(float) * EFFECTS_LEN);
+	cache->cycle = cycle;
+	cache->normalize = normalize;
+	cache->wave = this;
 
-	// TODO Fix possible race condition with audio thread here
-	// Or not, because the race condition would only just replace samples as they are being read, which just gives a click sound.
-	memcpy(postSamples, out, sizeof(float)*WAVE_LEN);
+	// The audio thread reads its own copy, published by audioUpdate()
+	memcpy(postSamples, cache->stages[POST_STAGES_LEN - 1], sizeof(float)*WAVE_LEN);
+}
 
-	// Convert wave to spectrum
-	RFFT(postSamples, postSpectrum, WAVE_LEN);
+void Wave::updateHarmonics() {
 	// Convert spectrum to harmonics
+	cabsv(spectrum, harmonics, WAVE_LEN / 2);
+	for (int i = 0; i < WAVE_LEN / 2; i++) {
+		harmonics[i] *= 2.0;
+	}
+}
+
+void Wave::updatePostHarmonics() {
+	cabsv(postSpectrum, postHarmonics, WAVE_LEN / 2);
 	for (int i = 0; i < WAVE_LEN / 2; i++) {
-		postHarmonics[i] = hypotf(postSpectrum[2 * i], postSpectrum[2 * i + 1]) * 2.0;
+		postHarmonics[i] *= 2.0;
 	}
 }
 
 void Wave::commitSamples() {
 	// Convert wave to spectrum
 	RFFT(samples, spectrum, WAVE_LEN);
-	// Convert spectrum to harmonics
-	for (int i = 0; i < WAVE_LEN / 2; i++) {
-		harmonics[i] = hypotf(spectrum[2 * i], spectrum[2 * i + 1]) * 2.0;
-	}
+	updateHarmonics();
 	updatePost();
 }
 
@@ -0,0 +1,35 @@
+#include "test.hpp"
+
+
+static int checks = 0;
+static int failures = 0;
+
+
+void testCheck(bool cond, const char *expr, const char *file, int line) {
+	checks++;
+	if (!cond) {
+		failures++;
+		printf("%s:%d: failed: %s\n", file, line, expr);
+	}
+}
+
+
+void testCheckNear(double a, double b, double tolerance, const char *expr, const char *file, int line) {
+	checks++;
+	if (!(fabs(a - b) <= tolerance)) {
+		failures++;
+		printf("%s:%d: failed: %s is %g, expected %g within %g\n", file, line, expr, a, b, tolerance);
+	}
+}
+
+
+int main(int argc, char **argv) {
+	parallelInit();
+	testMath();
+	testOscillator();
+	testWave();
+	parallelDestroy();
+
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures > 0;
+}
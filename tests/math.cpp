@@ -0,0 +1,188 @@
+#include "test.hpp"
+
+
+/** Ordered RFFT() of `in` computed directly in double precision */
+static void referenceRFFT(const float *in, double *out, int len) {
+	for (int k = 0; k <= len / 2; k++) {
+		double re = 0.0;
+		double im = 0.0;
+		for (int n = 0; n < len; n++) {
+			double phase = 2 * M_PI * ((int64_t) k * n % len) / len;
+			re += in[n] * cos(phase);
+			im -= in[n] * sin(phase);
+		}
+		re /= len;
+		im /= len;
+		if (k == 0) {
+			out[0] = re;
+		}
+		else if (k == len / 2) {
+			out[1] = re;
+		}
+		else {
+			out[2 * k] = re;
+			out[2 * k + 1] = im;
+		}
+	}
+}
+
+
+/** Checks RFFT() and IRFFT() at `len`, which selects FixedFFT<len> for WAVE_LEN and WAVE_LEN * 4 */
+static void testFFT(int len) {
+	std::vector<float> in(len);
+	for (int i = 0; i < len; i++) {
+		in[i] = randf() * 2.0 - 1.0;
+	}
+	std::vector<float> spectrum(len);
+	RFFT(in.data(), spectrum.data(), len);
+	std::vector<double> expected(len);
+	referenceRFFT(in.data(), expected.data(), len);
+	double error = 0.0;
+	for (int i = 0; i < len; i++) {
+		error = fmax(error, fabs(spectrum[i] - expected[i]));
+	}
+	CHECK_NEAR(error, 0.0, 1e-6);
+
+	std::vector<float> out(len);
+	IRFFT(spectrum.data(), out.data(), len);
+	error = 0.0;
+	for (int i = 0; i < len; i++) {
+		error = fmax(error, fabs(out[i] - in[i]));
+	}
+	CHECK_NEAR(error, 0.0, 1e-5);
+}
+
+
+/** The batched FFT must match RFFT() and IRFFT() for every signal */
+static void testFFTBatch(int len, int count) {
+	std::vector<float> in(len * count);
+	for (float &x : in) {
+		x = randf() * 2.0 - 1.0;
+	}
+	std::vector<float> out(len * count);
+	std::vector<const float*> ins(count);
+	std::vector<float*> outs(count);
+	for (int j = 0; j < count; j++) {
+		ins[j] = &in[j * len];
+		outs[j] = &out[j * len];
+	}
+	RFFTBatch(ins.data(), outs.data(), len, count);
+
+	std::vector<float> expected(len);
+	double error = 0.0;
+	for (int j = 0; j < count; j++) {
+		RFFT(ins[j], expected.data(), len);
+		for (int i = 0; i < len; i++) {
+			error = fmax(error, fabs(outs[j][i] - expected[i]));
+		}
+	}
+	CHECK_NEAR(error, 0.0, 1e-6);
+
+	std::vector<float> back(len * count);
+	std::vector<float*> backs(count);
+	for (int j = 0; j < count; j++) {
+		backs[j] = &back[j * len];
+	}
+	IRFFTBatch(outs.data(), backs.data(), len, count);
+	error = 0.0;
+	for (int j = 0; j < count; j++) {
+		IRFFT(outs[j], expected.data(), len);
+		for (int i = 0; i < len; i++) {
+			error = fmax(error, fabs(backs[j][i] - expected[i]));
+		}
+	}
+	CHECK_NEAR(error, 0.0, 1e-6);
+}
+
+
+/** Maximum absolute difference between `out` and `f` applied to `x` in double precision */
+static double maxError(const std::vector<float> &x, const std::vector<float> &out, double (*f)(double)) {
+	double error = 0.0;
+	for (size_t i = 0; i < x.size(); i++) {
+		error = fmax(error, fabs(out[i] - f(x[i])));
+	}
+	return error;
+}
+
+static double sin2pi(double x) {
+	return sin(2 * M_PI * x);
+}
+
+static double cos2pi(double x) {
+	return cos(2 * M_PI * x);
+}
+
+/** Checks the vectorized kernels against the accuracy documented in WaveEdit.hpp.
+An odd length exercises the partial vector at the end.
+*/
+static void testVectorMath() {
+	const int len = 10007;
+	std::vector<float> x(len);
+	std::vector<float> out(len);
+	std::vector<float> out2(len);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = (randf() * 2.0 - 1.0) * 1000.0;
+	}
+	sinv(x.data(), out.data(), len);
+	CHECK_NEAR(maxError(x, out, sin), 0.0, 2e-7);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = (randf() * 2.0 - 1.0) * 100.0;
+	}
+	sin2piv(x.data(), out.data(), len);
+	CHECK_NEAR(maxError(x, out, sin2pi), 0.0, 2e-7);
+	sincos2piv(x.data(), out.data(), out2.data(), len);
+	CHECK_NEAR(maxError(x, out, sin2pi), 0.0, 2e-7);
+	CHECK_NEAR(maxError(x, out2, cos2pi), 0.0, 2e-7);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = randf() * 2.0 - 1.0;
+	}
+	x[0] = -1.0;
+	x[1] = 1.0;
+	asinv(x.data(), out.data(), len);
+	CHECK_NEAR(maxError(x, out, asin), 0.0, 3e-7);
+
+	// Halves, negative halves, and floats too large to have a fraction
+	for (int i = 0; i < len; i++) {
+		x[i] = (i % 3 == 0) ? (i - len / 2) * 0.5 : (randf() * 2.0 - 1.0) * 100.0;
+	}
+	x[1] = 1e9;
+	x[2] = -16777217.0;
+	roundv(x.data(), out.data(), len);
+	bool rounded = true;
+	for (int i = 0; i < len; i++) {
+		if (out[i] != roundf(x[i]))
+			rounded = false;
+	}
+	CHECK(rounded);
+
+	std::vector<float> z(2 * len);
+	for (float &v : z) {
+		v = randf() * 2.0 - 1.0;
+	}
+	cabsv(z.data(), out.data(), len);
+	double error = 0.0;
+	for (int i = 0; i < len; i++) {
+		error = fmax(error, fabs(out[i] - hypot(z[2 * i], z[2 * i + 1])));
+	}
+	CHECK_NEAR(error, 0.0, 3e-7);
+
+	// In place
+	for (int i = 0; i < len; i++) {
+		x[i] = out2[i] = (randf() * 2.0 - 1.0) * 10.0;
+	}
+	sinv(x.data(), x.data(), len);
+	CHECK_NEAR(maxError(out2, x, sin), 0.0, 2e-7);
+}
+
+
+void testMath() {
+	testFFT(WAVE_LEN);
+	testFFT(WAVE_LEN * 4);
+	testFFT(512);
+	testFFTBatch(WAVE_LEN, BANK_LEN);
+	testFFTBatch(WAVE_LEN * 4, 3);
+	testVectorMath();
+}
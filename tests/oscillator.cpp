@@ -0,0 +1,173 @@
+#include "test.hpp"
+#include <string.h>
+
+
+static void checkMipSelect(float frequency, int expectedLevel, float expectedFrac) {
+	int level;
+	float levelFrac;
+	mipSelect(frequency, 44100.0, &level, &levelFrac);
+	CHECK(level == expectedLevel);
+	CHECK_NEAR(levelFrac, expectedFrac, 1e-3);
+}
+
+
+/** Peak of the crossfaded mip levels which play a sine wave at `frequency` */
+static float mipPeak(const WaveTable *table, float frequency) {
+	int level;
+	float levelFrac;
+	mipSelect(frequency, 44100.0, &level, &levelFrac);
+	const float *a = table->levels[level];
+	const float *b = table->levels[mini(level + 1, MIP_LEVELS - 1)];
+	float peak = 0.0;
+	for (int i = 0; i < WAVE_LEN; i++) {
+		peak = fmaxf(peak, fabsf(a[i] + (b[i] - a[i]) * levelFrac));
+	}
+	return peak;
+}
+
+
+static void testMipSelect() {
+	// At 44.1 kHz, level l becomes alias-free at 44100 / 256 * 2^l Hz
+	const float base = 44100.0 / WAVE_LEN;
+	checkMipSelect(100.0, 0, 1.0 + log2f(100.0 / base));
+	checkMipSelect(base * 1.5, 1, log2f(1.5));
+	checkMipSelect(base * powf(2.0, 2.25), 3, 0.25);
+	checkMipSelect(base * powf(2.0, 3.75), 4, 0.75);
+	checkMipSelect(base * powf(2.0, 4.5), 5, 0.5);
+	checkMipSelect(8000.0, MIP_LEVELS - 2, 0.0);
+	// Only the fundamental is left, and it is never faded out while below the Nyquist frequency
+	checkMipSelect(15000.0, MIP_LEVELS - 2, 0.0);
+	checkMipSelect(21000.0, MIP_LEVELS - 2, 0.0);
+
+	// The crossfade is continuous across octaves, and no harmonic with nonzero weight reaches the Nyquist frequency
+	float previous = 0.0;
+	float jump = 0.0;
+	bool monotonic = true;
+	bool aliasFree = true;
+	for (float frequency = 20.0; frequency < 22000.0; frequency *= 1.001) {
+		int level;
+		float levelFrac;
+		mipSelect(frequency, 44100.0, &level, &levelFrac);
+		int playedLevel = (levelFrac < 1.0) ? level : level + 1;
+		int harmonics = (WAVE_LEN / 2) >> playedLevel;
+		if ((harmonics - 1) * frequency >= 44100.0 / 2)
+			aliasFree = false;
+		float position = level + levelFrac;
+		if (frequency > 20.0)
+			jump = fmaxf(jump, position - previous);
+		if (position < previous)
+			monotonic = false;
+		previous = position;
+	}
+	CHECK(monotonic);
+	CHECK(aliasFree);
+	CHECK_NEAR(jump, 0.0, 0.01);
+
+	// A sine keeps its amplitude at every frequency below the Nyquist frequency
+	static WaveTable table;
+	float sine[WAVE_LEN];
+	for (int i = 0; i < WAVE_LEN; i++) {
+		sine[i] = sinf(2 * M_PI * i / WAVE_LEN);
+	}
+	table.build(sine);
+	for (float frequency : {100.0, 1000.0, 8000.0, 10000.0, 20000.0}) {
+		CHECK_NEAR(mipPeak(&table, frequency), 1.0, 1e-3);
+	}
+}
+
+
+/** Linear interpolation between the crossfaded mip levels of `table` at wave position `pos` */
+static float tableSample(const WaveTable *table, int level, float levelFrac, float pos) {
+	int index = mini((int) pos, WAVE_LEN - 1);
+	float frac = pos - index;
+	const float *a = table->levels[level];
+	const float *b = table->levels[mini(level + 1, MIP_LEVELS - 1)];
+	float va = a[index] + (a[index + 1] - a[index]) * frac;
+	float vb = b[index] + (b[index + 1] - b[index]) * frac;
+	return va + (vb - va) * levelFrac;
+}
+
+
+/** VoicePool must match rendering each voice on its own, one sample at a time, including partial voice groups and morphs across waves */
+static void testVoicePool() {
+	static WaveTable tables[BANK_LEN];
+	for (int w = 0; w < BANK_LEN; w++) {
+		float samples[WAVE_LEN];
+		for (int i = 0; i < WAVE_LEN; i++) {
+			samples[i] = randf() * 2.0 - 1.0;
+		}
+		tables[w].build(samples);
+	}
+
+	const int len = 512;
+	const float sampleRate = 44100.0;
+	float frequency[len];
+	float morphX[len];
+	float morphY[len];
+	float morphZ[len];
+	float maxFrequency = 0.0;
+	for (int i = 0; i < len; i++) {
+		frequency[i] = 200.0 + 100.0 * sinf(i * 0.01);
+		maxFrequency = fmaxf(maxFrequency, frequency[i]);
+		morphX[i] = clampf(3.0 + 3.0 * sinf(i * 0.02), 0.0, BANK_GRID_WIDTH - 1);
+		morphY[i] = clampf(4.0 + 3.5 * cosf(i * 0.015), 0.0, BANK_GRID_HEIGHT - 1);
+		morphZ[i] = 30.0 + 30.0 * sinf(i * 0.013);
+	}
+
+	static VoicePool pool;
+	for (int xy = 0; xy < 2; xy++) {
+		for (int count : {1, 5, 8, 13}) {
+			pool = VoicePool();
+			pool.count = count;
+			for (int v = 0; v < count; v++) {
+				pool.ratio[v] = powf(2.0, v / 7.0);
+				pool.morphOffset[v] = v * 0.37 - 2.0;
+			}
+			float phase[VOICES_MAX];
+			memcpy(phase, pool.phase, sizeof(phase));
+			float out[len];
+			pool.process(tables, frequency, xy ? morphX : NULL, xy ? morphY : NULL, morphZ, sampleRate, out, len);
+
+			float expected[len] = {};
+			float gain = 1.0 / sqrtf(count);
+			for (int v = 0; v < count; v++) {
+				int level;
+				float levelFrac;
+				mipSelect(maxFrequency * pool.ratio[v], sampleRate, &level, &levelFrac);
+				for (int i = 0; i < len; i++) {
+					float pos = phase[v] * WAVE_LEN;
+					float y;
+					if (xy) {
+						int xi = morphX[i];
+						int yi = morphY[i];
+						int x1 = eucmodi(xi + 1, BANK_GRID_WIDTH);
+						int y1 = eucmodi(yi + 1, BANK_GRID_HEIGHT);
+						float y0 = crossf(tableSample(&tables[yi * BANK_GRID_WIDTH + xi], level, levelFrac, pos), tableSample(&tables[yi * BANK_GRID_WIDTH + x1], level, levelFrac, pos), morphX[i] - xi);
+						float y1f = crossf(tableSample(&tables[y1 * BANK_GRID_WIDTH + xi], level, levelFrac, pos), tableSample(&tables[y1 * BANK_GRID_WIDTH + x1], level, levelFrac, pos), morphX[i] - xi);
+						y = crossf(y0, y1f, morphY[i] - yi);
+					}
+					else {
+						float z = clampf(morphZ[i] + pool.morphOffset[v], 0.0, BANK_LEN - 1);
+						int zi = z;
+						y = crossf(tableSample(&tables[zi], level, levelFrac, pos), tableSample(&tables[eucmodi(zi + 1, BANK_LEN)], level, levelFrac, pos), z - zi);
+					}
+					expected[i] += y * gain;
+					phase[v] += frequency[i] * pool.ratio[v] / sampleRate;
+					phase[v] -= floorf(phase[v]);
+				}
+			}
+
+			float error = 0.0;
+			for (int i = 0; i < len; i++) {
+				error = fmaxf(error, fabsf(out[i] - expected[i]));
+			}
+			CHECK_NEAR(error, 0.0, 1e-4);
+		}
+	}
+}
+
+
+void testOscillator() {
+	testMipSelect();
+	testVoicePool();
+}
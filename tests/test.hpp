@@ -0,0 +1,33 @@
+#pragma once
+
+#include "src/WaveEdit.hpp"
+
+
+/** Records a failure if `cond` is false */
+#define CHECK(cond) testCheck((cond), #cond, __FILE__, __LINE__)
+/** Records a failure if `a` and `b` differ by more than `tolerance` */
+#define CHECK_NEAR(a, b, tolerance) testCheckNear((a), (b), (tolerance), #a, __FILE__, __LINE__)
+
+void testCheck(bool cond, const char *expr, const char *file, int line);
+void testCheckNear(double a, double b, double tolerance, const char *expr, const char *file, int line);
+
+
+////////////////////
+// math.cpp
+////////////////////
+
+void testMath();
+
+
+////////////////////
+// oscillator.cpp
+////////////////////
+
+void testOscillator();
+
+
+////////////////////
+// wave.cpp
+////////////////////
+
+void testWave();
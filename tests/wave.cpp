@@ -0,0 +1,104 @@
+#include "test.hpp"
+#include <string.h>
+
+
+// Consecutive waves use different cache slots, like the waves of a bank
+static Wave waves[2];
+static Wave &wave = waves[0];
+static Wave &reference = waves[1];
+
+/** Returns the largest difference between the effect chain output of `wave`, reused from its cache, and a full recompute */
+static float cachedError() {
+	wave.commitSamples();
+	// Fill the cache of the reference with the stages of unrelated samples, so committing the original samples recomputes every stage
+	reference = wave;
+	for (int i = 0; i < WAVE_LEN; i++) {
+		reference.samples[i] = randf() * 2.0 - 1.0;
+	}
+	reference.commitSamples();
+	memcpy(reference.samples, wave.samples, sizeof(wave.samples));
+	reference.commitSamples();
+
+	float error = 0.0;
+	for (int i = 0; i < WAVE_LEN; i++) {
+		error = fmaxf(error, fabsf(wave.postSamples[i] - reference.postSamples[i]));
+	}
+	return error;
+}
+
+
+static void testPostCache() {
+	wave.clear();
+	for (int i = 0; i < WAVE_LEN; i++) {
+		wave.samples[i] = randf() * 2.0 - 1.0;
+	}
+	wave.effects[RING] = 0.05;
+	wave.effects[CHEBYSHEV] = 0.5;
+	CHECK_NEAR(cachedError(), 0.0, 0.0);
+	// The ring modulation frequency is quantized, so its output is unchanged, but the Chebyshev stage after it must still be applied
+	wave.effects[RING] = 0.06;
+	wave.effects[LOWPASS] = 0.3;
+	CHECK_NEAR(cachedError(), 0.0, 0.0);
+
+	// Edit random stages, often leaving stages unchanged in between
+	float worst = 0.0;
+	for (int n = 0; n < 200; n++) {
+		int edits = 1 + rand() % 3;
+		for (int j = 0; j < edits; j++) {
+			wave.effects[rand() % EFFECTS_LEN] = (rand() % 4 == 0) ? 0.0 : randf();
+		}
+		if (rand() % 10 == 0)
+			wave.cycle = !wave.cycle;
+		if (rand() % 10 == 0)
+			wave.normalize = !wave.normalize;
+		worst = fmaxf(worst, cachedError());
+	}
+	CHECK_NEAR(worst, 0.0, 0.0);
+}
+
+
+/** The comb filter scales each harmonic by the sum of its taps, with the parameter quantized to the slider resolution */
+static void testComb() {
+	const int harmonic = 37;
+	const double amplitude = 0.5;
+	wave.clear();
+	for (int i = 0; i < WAVE_LEN; i++) {
+		wave.samples[i] = amplitude * cos(2 * M_PI * harmonic * i / WAVE_LEN);
+	}
+	wave.effects[COMB] = 0.3001;
+	wave.commitSamples();
+
+	// Tap j is delayed by 0.3 * j periods with amplitude 0.75^j / 4
+	double kr = 0.0;
+	double ki = 0.0;
+	for (int j = 0; j < 40; j++) {
+		double a = pow(0.75, j) * 0.25;
+		kr += a * cos(2 * M_PI * harmonic * 0.3 * j);
+		ki -= a * sin(2 * M_PI * harmonic * 0.3 * j);
+	}
+	double error = 0.0;
+	for (int i = 0; i < WAVE_LEN; i++) {
+		double phase = 2 * M_PI * harmonic * i / WAVE_LEN;
+		double expected = amplitude * (kr * cos(phase) - ki * sin(phase));
+		error = fmax(error, fabs(wave.postSamples[i] - expected));
+	}
+	CHECK_NEAR(error, 0.0, 1e-5);
+}
+
+
+/** Waves allocated with new keep the alignment which the SIMD code assumes */
+static void testAlignment() {
+	Bank *bank = new Bank();
+	CHECK((uintptr_t) bank % SIMD_ALIGN == 0);
+	delete bank;
+	Wave *array = new Wave[3];
+	CHECK((uintptr_t) &array[1] % SIMD_ALIGN == 0);
+	delete[] array;
+}
+
+
+void testWave() {
+	testPostCache();
+	testComb();
+	testAlignment();
+}